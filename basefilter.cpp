@@ -16,6 +16,26 @@ QImage BaseFilter::getImage() {
     return image;
 }
 
+/*!
+ * \brief An accessor for the error variable.
+ * \return Why the last filtering process failed, or an empty string if it did not
+ */
+QString BaseFilter::getError() {
+    return error;
+}
+
+/*!
+ * \brief The cache of results shared by all filters.
+ *
+ * A filter looks up a hash of its inputs and parameters before running, and stores its outputs after.
+ *
+ * \return The cache
+ */
+FilterCache &BaseFilter::resultCache() {
+    static FilterCache cache;
+    return cache;
+}
+
 /*!
  * \brief The user has pressed the "Cancel" button during a filtering process.
  */
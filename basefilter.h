@@ -3,6 +3,9 @@
 
 #include <QImage>
 #include <QObject>
+#include "filtercache.h"
+#include "filtertrace.h"
+#include "imagehash.h"
 
 /*!
  * \brief An abstract base class for all filters.
@@ -13,6 +16,8 @@ public:
     BaseFilter() = default;
     void setImage(QImage);
     QImage getImage();
+    QString getError();
+    static FilterCache &resultCache();
     virtual void apply() = 0; /*!< A virtual function that all non-virtual derived filters override. */
     signals:
     void progressUpdated(int value); /*!< A signal for communicating the progress of the filtering process with MainWindow. */
@@ -21,6 +26,7 @@ public slots:
 protected:
     QImage image; /*!< An image stored inside the filter */
     bool cancelled /*!< A boolean variable used to tell if the user has pressed the "Cancel" button during a filtering process */;
+    QString error; /*!< Why the last filtering process stopped early, empty if it did not fail */
 };
 
 #endif // BASEFILTER_H
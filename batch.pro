@@ -0,0 +1,28 @@
+# The command-line batch tool: the same filters as the GUI without QtWidgets,
+# so it starts quickly and runs on machines without a display server.
+# Build it next to the GUI with: qmake batch.pro && make
+
+QT = core gui concurrent network # network for the local socket of --serve
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = h22batch
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(filters.pri)
+
+SOURCES += \
+    batchmain.cpp \
+    batchrunner.cpp \
+    batchserver.cpp
+
+HEADERS += \
+    batchrunner.h \
+    batchserver.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,159 @@
+/*!
+ * \brief The command-line batch tool, running one filter over files and folders without a user interface, \
+ * or serving filters to other programs on this host with --serve.
+ *
+ * Example: h22batch blur photos -o blurred -s high
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QSocketNotifier>
+#include <cstdio>
+#include "batchrunner.h"
+#include "batchserver.h"
+#include "filtertrace.h"
+#include "imageio.h"
+#ifdef Q_OS_UNIX
+#include <csignal>
+#include <unistd.h>
+
+namespace {
+
+int signalPipe[2]; // written by the signal handler, read by the event loop
+
+/*!
+ * \brief Wake the event loop up on a signal, with the only kind of call a signal handler may make.
+ */
+void onSignal(int) {
+    char byte = 0;
+    ssize_t written = ::write(signalPipe[1], &byte, 1);
+    (void)written;
+}
+
+/*!
+ * \brief Quit the event loop on SIGINT and SIGTERM instead of dying, so that the server frees its shared memory.
+ * \param app The application
+ */
+void quitOnSignals(QCoreApplication &app) {
+    if (::pipe(signalPipe) != 0) {
+        return;
+    }
+    QSocketNotifier *notifier = new QSocketNotifier(signalPipe[0], QSocketNotifier::Read, &app);
+    QObject::connect(notifier, &QSocketNotifier::activated, &app, &QCoreApplication::quit);
+    struct sigaction action = {};
+    action.sa_handler = onSignal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+}
+
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setOrganizationName("H22");
+    QCoreApplication::setApplicationName("project_H22"); // share the settings and the cache directory with the GUI
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs one filter of the Light-weight Image Encryptor over files and folders.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("operation", "blur, deblur, encode, decode, insert or extract.");
+    parser.addPositionalArgument("inputs", "Files or folders to process. Folders are searched recursively.", "inputs...");
+    QCommandLineOption outputOption(QStringList{"o", "output"}, "The folder the results are written to.", "folder");
+    QCommandLineOption strengthOption(QStringList{"s", "strength"},
+            "The strength for blur and deblur: low, medium, high, or auto for deblur (default: low, auto for deblur).",
+            "strength");
+    QCommandLineOption baseOption(QStringList{"b", "base"}, "The base image for encode, or the GIF for insert.", "file");
+    QCommandLineOption encryptedOption(QStringList{"e", "encrypted"}, "Encode the secret before insert, decode it after extract.");
+    QCommandLineOption jobsOption(QStringList{"j", "jobs"}, "How many inputs are processed at once (default: one per core).", "count");
+    QCommandLineOption formatOption("format",
+            "The format of the images written: png; qoi, which is several times faster; or pam or planar, which are "
+            "uncompressed and mapped rather than read (default: the GUI's setting).",
+            "format");
+    QCommandLineOption maxTimeOption("max-time",
+            "Skip the inputs predicted to take longer than this many seconds each (default: no limit).", "seconds");
+    QCommandLineOption maxMemoryOption("max-memory",
+            "Run fewer jobs at once if the inputs are predicted to need more memory than this (default: no limit).", "MB");
+    QCommandLineOption traceOption("trace", "Record the stages of every filter into a Chrome trace file, and print a summary.", "file");
+    parser.addOption(outputOption);
+    parser.addOption(strengthOption);
+    parser.addOption(baseOption);
+    parser.addOption(encryptedOption);
+    parser.addOption(jobsOption);
+    parser.addOption(formatOption);
+    parser.addOption(maxTimeOption);
+    parser.addOption(maxMemoryOption);
+    QCommandLineOption profileOption("profile",
+            "Also count CPU cycles, instructions, cache and branch misses in every stage (Linux only), and print them with the summary.");
+    parser.addOption(traceOption);
+    parser.addOption(profileOption);
+    QCommandLineOption serveOption("serve",
+            "Instead of running one operation, take jobs from other programs on the local socket <name> until stopped; "
+            "see the README for the protocol.", "name");
+    parser.addOption(serveOption);
+    parser.process(a);
+
+    if (parser.isSet(serveOption)) {
+        BatchServer server(parser.value(jobsOption).toInt());
+        QString error;
+        if (!server.listen(parser.value(serveOption), error)) {
+            fprintf(stderr, "%s\n", qPrintable(error));
+            return 2;
+        }
+#ifdef Q_OS_UNIX
+        quitOnSignals(a);
+#endif
+        printf("Listening on %s\n", qPrintable(parser.value(serveOption)));
+        fflush(stdout);
+        return a.exec();
+    }
+
+    QStringList arguments = parser.positionalArguments();
+    if (arguments.size() < 2 || !parser.isSet(outputOption)) {
+        fprintf(stderr, "%s", qPrintable(parser.helpText()));
+        return 2;
+    }
+
+    BatchRunner::Options options;
+    options.operation = arguments.takeFirst();
+    options.output = parser.value(outputOption);
+    options.base = parser.value(baseOption);
+    options.encrypted = parser.isSet(encryptedOption);
+    options.jobs = parser.value(jobsOption).toInt();
+    options.format = parser.isSet(formatOption) ? parser.value(formatOption) : imageio::intermediateFormat();
+    options.maxTime = parser.value(maxTimeOption).toInt();
+    options.maxMemory = parser.value(maxMemoryOption).toInt();
+    QString strength = parser.value(strengthOption);
+    if (strength.isEmpty()) {
+        options.strength = options.operation == "deblur" ? 0 : 10;
+    } else {
+        options.strength = strength == "low" ? 10 : strength == "medium" ? 16 : strength == "high" ? 20
+                : strength == "auto" ? 0 : strength.toInt();
+    }
+
+    BatchRunner runner(options);
+    QString error;
+    if (!runner.prepare(error)) {
+        fprintf(stderr, "%s\n", qPrintable(error));
+        return 2;
+    }
+    bool tracing = parser.isSet(traceOption) || parser.isSet(profileOption);
+    if (parser.isSet(profileOption) && !FilterTrace::setProfiling(true, error)) {
+        fprintf(stderr, "Profiling is not available, only timing: %s\n", qPrintable(error));
+    }
+    FilterTrace::setEnabled(tracing);
+    int status = runner.run(runner.collect(arguments));
+    if (tracing) {
+        FilterTrace::setEnabled(false);
+        if (parser.isSet(traceOption)) {
+            QFile trace(parser.value(traceOption));
+            if (!trace.open(QIODevice::WriteOnly) || trace.write(FilterTrace::chromeTrace()) < 0) {
+                fprintf(stderr, "Cannot write %s\n", qPrintable(parser.value(traceOption)));
+            }
+        }
+        fprintf(stderr, "%s", qPrintable(FilterTrace::summary()));
+    }
+    return status;
+}
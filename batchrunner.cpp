@@ -0,0 +1,525 @@
+#include "batchrunner.h"
+#include "blurfilter.h"
+#include "deblurfilter.h"
+#include "decodefilter.h"
+#include "encodefilter.h"
+#include "extractfilter.h"
+#include "imageio.h"
+#include "insertfilter.h"
+#include <QBuffer>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QMovie>
+#include <QPair>
+#include <QSemaphore>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cstdio>
+
+const int BatchRunner::PREFETCH = 2;
+
+/*!
+ * \brief constructor: remember what to run.
+ * \param opts What to run and where to write the results
+ */
+BatchRunner::BatchRunner(const Options &opts) :
+        options(opts) {
+}
+
+/*!
+ * \brief The operations the batch tool can run, named like the tabs of the GUI.
+ * \return The names of the operations
+ */
+QStringList BatchRunner::operations() {
+    return QStringList{"blur", "deblur", "encode", "decode", "insert", "extract"};
+}
+
+/*!
+ * \brief Check the options and read what every input shares, before any input is read.
+ * \param error Set to why the options cannot be used, if they cannot
+ * \return Whether the options can be used
+ */
+bool BatchRunner::prepare(QString &error) {
+    if (!operations().contains(options.operation)) {
+        error = "Unknown operation \"" + options.operation + "\", expected one of " + operations().join(", ");
+        return false;
+    }
+    if (options.strength != 10 && options.strength != 16 && options.strength != 20
+            && !(options.strength == 0 && options.operation == "deblur")) {
+        error = "The strength must be low (10), medium (16) or high (20), or auto when deblurring";
+        return false;
+    }
+    if (options.format != "png" && options.format != "qoi" && options.format != "pam" && options.format != "planar") {
+        error = "The format must be png, qoi, pam or planar";
+        return false;
+    }
+    if (options.operation == "encode") {
+        base = imageio::read(options.base);
+        if (base.isNull()) {
+            error = "Encoding needs a base image, given with --base";
+            return false;
+        }
+    }
+    if (options.operation == "insert") {
+        QFile file(options.base);
+        if (!file.open(QIODevice::ReadOnly)) {
+            error = "Inserting needs a GIF, given with --base";
+            return false;
+        }
+        baseGif = file.readAll();
+        QBuffer buffer(&baseGif);
+        QMovie movie(&buffer);
+        if (movie.frameCount() < 5) {
+            error = "The GIF given with --base is too short, it needs at least 5 frames";
+            return false;
+        }
+    }
+    if (!QDir().mkpath(options.output)) {
+        error = "Cannot create the output folder \"" + options.output + "\"";
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief Check if a folder holds the four images written by blurring, img, red, green and blue, as PNG or QOI.
+ * \param path The folder
+ * \return Whether it can be deblurred
+ */
+bool BatchRunner::isDeblurFolder(const QString &path) {
+    return QFileInfo::exists(imageio::find(path + "/img"));
+}
+
+/*!
+ * \brief Turn the files and folders given on the command line into one path per input.
+ *
+ * Folders are searched recursively: for images when blurring, encoding, decoding or inserting, \
+ * for GIF files when extracting, and for folders written by blurring when deblurring.
+ *
+ * \param paths The files and folders given
+ * \return The inputs, sorted so that runs are repeatable
+ */
+QStringList BatchRunner::collect(const QStringList &paths) const {
+    QStringList nameFilters;
+    if (options.operation == "extract") {
+        nameFilters << "*.gif";
+    } else {
+        for (const QByteArray &format : QImageReader::supportedImageFormats()) {
+            nameFilters << "*." + QString::fromLatin1(format);
+        }
+        nameFilters << "*.qoi" << "*.pam" << "*.planar";
+    }
+
+    QStringList inputs;
+    for (const QString &path : paths) {
+        if (!QFileInfo(path).isDir()) {
+            inputs << path;
+            continue;
+        }
+        if (options.operation == "deblur") {
+            if (isDeblurFolder(path)) {
+                inputs << path;
+                continue;
+            }
+            QDirIterator it(path, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                QString folder = it.next();
+                if (isDeblurFolder(folder)) {
+                    inputs << folder;
+                }
+            }
+            continue;
+        }
+        QDirIterator it(path, nameFilters, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            inputs << it.next();
+        }
+    }
+    inputs.sort();
+    return inputs;
+}
+
+/*!
+ * \brief Read everything one input needs from disk.
+ * \param path The file or folder of the input
+ * \return The input, with its error set if it could not be read
+ */
+BatchRunner::Input BatchRunner::load(const QString &path) const {
+    Input input;
+    input.path = path;
+    QFileInfo info(path);
+    input.name = info.isDir() ? info.fileName() : info.completeBaseName();
+
+    if (options.operation == "extract") {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            input.error = "cannot be read";
+        }
+        input.gif = file.readAll();
+        return input;
+    }
+
+    if (options.operation != "deblur") {
+        input.image = imageio::read(path);
+        if (input.image.isNull()) {
+            input.error = "is not an image";
+        }
+        return input;
+    }
+
+    // A folder written by blurring: the blurred image, three residues and the packed blocks if any
+    input.image = imageio::read(imageio::find(path + "/img"));
+    input.red = imageio::read(imageio::find(path + "/red"));
+    input.green = imageio::read(imageio::find(path + "/green"));
+    input.blue = imageio::read(imageio::find(path + "/blue"));
+    if (input.image.isNull() || input.red.isNull() || input.green.isNull() || input.blue.isNull()) {
+        input.error = "needs img, red, green and blue images, as .png, .qoi, .pam or .planar";
+        return input;
+    }
+    input.error = readTiles(path, input.size, input.tiles);
+    if (!input.error.isEmpty()) {
+        return input;
+    }
+    for (const QPoint &tile : input.tiles) {
+        if (tile.x() >= input.image.width() || tile.y() >= input.image.height()) {
+            input.error = "has a tiles.txt listing blocks outside the blurred image";
+            return input;
+        }
+    }
+    return input;
+}
+
+/*!
+ * \brief Read the tiles.txt of a folder written by blurring only some regions: the block size, then the packed blocks.
+ * \param folder The folder
+ * \param size Set to the block size, 0 if there is no tiles.txt
+ * \param tiles Set to the top-left corners of the packed blocks, which lie on the grid of the size
+ * \return Why tiles.txt cannot be used, or an empty string
+ */
+QString BatchRunner::readTiles(const QString &folder, int &size, QVector<QPoint> &tiles) {
+    size = 0;
+    tiles.clear();
+    QFile tilesFile(folder + "/tiles.txt");
+    if (!tilesFile.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QString();
+    }
+    QTextStream in(&tilesFile);
+    QString word;
+    in >> word >> size;
+    if (word != "size" || (size != 10 && size != 16 && size != 20)) {
+        return "has a tiles.txt that does not start with the strength, e.g. \"size 10\"";
+    }
+    while (true) {
+        int x = -1, y = -1;
+        in >> x >> y;
+        if (in.status() != QTextStream::Ok) {
+            break;
+        }
+        if (x < 0 || y < 0 || x % size != 0 || y % size != 0) {
+            return "has a tiles.txt listing blocks outside the blurred image";
+        }
+        tiles.append(QPoint(x, y));
+    }
+    return QString();
+}
+
+/*!
+ * \brief Predict the cost of one input from the size in its image header, without decoding it.
+ * \param path The file or folder of the input
+ * \return The prediction, zero for inserting and extracting, which are not predicted
+ */
+CostModel::Estimate BatchRunner::estimate(const QString &path) const {
+    CostModel::Operation operation;
+    if (options.operation == "blur") {
+        operation = CostModel::Blur;
+    } else if (options.operation == "deblur") {
+        operation = CostModel::Deblur;
+    } else if (options.operation == "encode") {
+        operation = CostModel::Encode;
+    } else if (options.operation == "decode") {
+        operation = CostModel::Decode;
+    } else {
+        return CostModel::Estimate();
+    }
+    if (operation != CostModel::Deblur) {
+        return CostModel::estimate(operation, imageio::size(path), options.strength);
+    }
+    // Like deblur(): the strength of tiles.txt comes first, and only the blocks it lists are deblurred
+    int size = 0;
+    QVector<QPoint> tiles;
+    if (!readTiles(path, size, tiles).isEmpty()) {
+        size = 0; // load() fails the input, so it is predicted as if there were no tiles.txt
+    }
+    return CostModel::estimate(operation, imageio::size(imageio::find(path + "/img")), size != 0 ? size : options.strength,
+            size != 0 ? qMax(tiles.size(), 1) : 0);
+}
+
+/*!
+ * \brief Filter one input and write its results.
+ * \param input The input, read by load()
+ * \return Why the input failed, or an empty string
+ */
+QString BatchRunner::process(const Input &input) const {
+    if (!input.error.isEmpty()) {
+        return input.error;
+    }
+    if (options.operation == "blur") {
+        return blur(input);
+    } else if (options.operation == "deblur") {
+        return deblur(input);
+    } else if (options.operation == "encode") {
+        return encode(input);
+    } else if (options.operation == "decode") {
+        return decode(input);
+    } else if (options.operation == "insert") {
+        return insert(input);
+    }
+    return extract(input);
+}
+
+/*!
+ * \brief Blur one image and write the folder the deblur tab opens: img, red, green and blue, in the format of the options.
+ *
+ * The residues are written with the fastest compression, like the GUI does.
+ *
+ * \param input The image
+ * \return Why it failed, or an empty string
+ */
+QString BatchRunner::blur(const Input &input) const {
+    BlurFilter filter;
+    filter.setImage(input.image);
+    filter.setSize(options.strength);
+    filter.apply();
+
+    QString folder = options.output + "/" + input.name;
+    if (!QDir().mkpath(folder)
+            || !imageio::write(filter.getImage(), folder + "/img." + options.format)
+            || !imageio::write(filter.getRedResidue(), folder + "/red." + options.format, imageio::Fast)
+            || !imageio::write(filter.getGreenResidue(), folder + "/green." + options.format, imageio::Fast)
+            || !imageio::write(filter.getBlueResidue(), folder + "/blue." + options.format, imageio::Fast)) {
+        return "cannot be written to " + folder;
+    }
+    return QString();
+}
+
+/*!
+ * \brief Deblur one folder written by blurring and write the image as <name> in the format of the options.
+ *
+ * The strength comes from tiles.txt if there is one, then from the options, and is detected if neither gives it.
+ *
+ * \param input The folder
+ * \return Why it failed, or an empty string
+ */
+QString BatchRunner::deblur(const Input &input) const {
+    DeblurFilter filter;
+    filter.setImage(input.image, input.red, input.green, input.blue);
+    filter.setTiles(input.tiles);
+    int size = input.size != 0 ? input.size : options.strength;
+    if (size == 0) {
+        size = filter.detectSize(QVector<int>{10, 16, 20});
+    }
+    filter.setSize(size);
+    filter.apply();
+    if (!filter.getError().isEmpty()) {
+        return filter.getError();
+    }
+
+    QString file = options.output + "/" + input.name + "." + options.format;
+    if (!imageio::write(filter.getImage(), file)) {
+        return "cannot be written to " + file;
+    }
+    return QString();
+}
+
+/*!
+ * \brief Encode one secret image into the base image and write it as <name> in the format of the options.
+ * \param input The secret image
+ * \return Why it failed, or an empty string
+ */
+QString BatchRunner::encode(const Input &input) const {
+    EncodeFilter filter;
+    filter.setImage(base);
+    filter.setSecret(input.image);
+    filter.apply();
+
+    QString file = options.output + "/" + input.name + "." + options.format;
+    if (!imageio::write(filter.getImage(), file)) {
+        return "cannot be written to " + file;
+    }
+    return QString();
+}
+
+/*!
+ * \brief Decode the secret image from one cipher image and write it as <name> in the format of the options.
+ * \param input The cipher image
+ * \return Why it failed, or an empty string
+ */
+QString BatchRunner::decode(const Input &input) const {
+    DecodeFilter filter;
+    filter.setImage(input.image);
+    filter.apply();
+
+    QString file = options.output + "/" + input.name + "." + options.format;
+    if (!imageio::write(filter.getImage(), file)) {
+        return "cannot be written to " + file;
+    }
+    return QString();
+}
+
+/*!
+ * \brief Insert one secret image into the GIF and write it as <name>.gif.
+ *
+ * When encrypted, the secret is first encoded into the frame it replaces, like the insert tab does.
+ *
+ * \param input The secret image
+ * \return Why it failed, or an empty string
+ */
+QString BatchRunner::insert(const Input &input) const {
+    QByteArray bytes = baseGif; // every input reads its own copy, QMovie moves through the buffer
+    QBuffer buffer(&bytes);
+    QMovie movie(&buffer);
+    InsertFilter filter;
+    filter.setMovie(&movie);
+    filter.setImage(input.image);
+    if (options.encrypted) {
+        QByteArray frameBytes = baseGif;
+        QBuffer frameBuffer(&frameBytes);
+        QMovie frames(&frameBuffer);
+        for (int i = 0; i < 4; i++) {
+            frames.jumpToNextFrame();
+        }
+        EncodeFilter encoder;
+        encoder.setImage(frames.currentImage());
+        encoder.setSecret(input.image);
+        encoder.apply();
+        filter.setImage(encoder.getImage());
+    }
+
+    QString file = options.output + "/" + input.name + ".gif";
+    filter.setDestination(file);
+    filter.apply();
+    if (QFileInfo(file).size() == 0) {
+        return "cannot be written to " + file;
+    }
+    return QString();
+}
+
+/*!
+ * \brief Extract the secret image from one GIF and write it as <name> in the format of the options.
+ *
+ * When encrypted, the extracted frame is decoded too, like the extract tab does.
+ *
+ * \param input The GIF
+ * \return Why it failed, or an empty string
+ */
+QString BatchRunner::extract(const Input &input) const {
+    QByteArray bytes = input.gif;
+    QBuffer buffer(&bytes);
+    QMovie movie(&buffer);
+    if (movie.frameCount() < 5) {
+        return "has fewer than 5 frames, so nothing was inserted into it";
+    }
+    ExtractFilter filter;
+    filter.setMovie(&movie);
+    filter.apply();
+    QImage result = filter.getImage();
+    if (options.encrypted) {
+        DecodeFilter decoder;
+        decoder.setImage(result);
+        decoder.apply();
+        result = decoder.getImage();
+    }
+
+    QString file = options.output + "/" + input.name + "." + options.format;
+    if (!imageio::write(result, file)) {
+        return "cannot be written to " + file;
+    }
+    return QString();
+}
+
+/*!
+ * \brief Filter every input and write the results, reporting the inputs that failed on the standard error.
+ *
+ * Inputs are read on one thread pool and filtered on another, each with one thread per job. \
+ * Reading blocks once PREFETCH inputs per job are waiting or being filtered, which bounds the memory used. \
+ * The inputs predicted to take longest start first, so that no long one is left running alone at the end. \
+ * Inputs predicted to go over the time budget are skipped, and fewer jobs run if the memory budget needs it.
+ *
+ * \param inputs The inputs, as given by collect()
+ * \return 0 if every input succeeded, 1 otherwise
+ */
+int BatchRunner::run(const QStringList &inputs) {
+    int jobs = options.jobs > 0 ? options.jobs : QThread::idealThreadCount();
+    failed.store(0);
+
+    // Predict every input from its header
+    QVector<QPair<CostModel::Estimate, QString>> planned;
+    qint64 total = 0;
+    qint64 peak = 0;
+    for (const QString &path : inputs) {
+        CostModel::Estimate cost = estimate(path);
+        if (options.maxTime > 0 && cost.milliseconds > options.maxTime * Q_INT64_C(1000)) {
+            failed.ref();
+            fprintf(stderr, "%s would take %s, over --max-time\n", qPrintable(QDir::toNativeSeparators(path)),
+                    qPrintable(CostModel::describeTime(cost.milliseconds)));
+            continue;
+        }
+        planned.append(qMakePair(cost, path));
+        total += cost.milliseconds;
+        peak = qMax(peak, cost.bytes);
+    }
+    std::stable_sort(planned.begin(), planned.end(), [](const QPair<CostModel::Estimate, QString> &a,
+            const QPair<CostModel::Estimate, QString> &b) {
+        return a.first.milliseconds > b.first.milliseconds;
+    });
+    if (options.maxMemory > 0 && peak > 0) {
+        // every job may hold PREFETCH inputs, one of them being filtered
+        int fitting = static_cast<int>(options.maxMemory * Q_INT64_C(1024) * 1024 / (peak * PREFETCH));
+        if (fitting < jobs) {
+            jobs = qMax(1, fitting);
+            fprintf(stderr, "Running %d jobs at once to stay within --max-memory\n", jobs);
+        }
+    }
+    if (total > 0) {
+        printf("Predicted: %s on one thread, up to %s per input\n", qPrintable(CostModel::describeTime(total)),
+                qPrintable(CostModel::describeMemory(peak)));
+        fflush(stdout);
+    }
+
+    QThreadPool readers;
+    readers.setMaxThreadCount(jobs);
+    QThreadPool workers;
+    workers.setMaxThreadCount(jobs);
+    QSemaphore slots(PREFETCH * jobs);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (const QPair<CostModel::Estimate, QString> &input : planned) {
+        const QString &path = input.second;
+        slots.acquire();
+        QtConcurrent::run(&readers, [this, path, &workers, &slots]() {
+            Input input = load(path);
+            QtConcurrent::run(&workers, [this, input, &slots]() {
+                QString error = process(input);
+                if (!error.isEmpty()) {
+                    failed.ref();
+                    fprintf(stderr, "%s %s\n", qPrintable(QDir::toNativeSeparators(input.path)), qPrintable(error));
+                }
+                slots.release();
+            });
+        });
+    }
+    readers.waitForDone(); // every input has been handed to the workers after this
+    workers.waitForDone();
+
+    int failures = failed.load();
+    printf("%d of %d done in %.1f s\n", inputs.size() - failures, inputs.size(), timer.elapsed() / 1000.0);
+    return failures == 0 ? 0 : 1;
+}
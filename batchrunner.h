@@ -0,0 +1,77 @@
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QAtomicInt>
+#include <QByteArray>
+#include <QImage>
+#include <QPoint>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include "costmodel.h"
+
+/*!
+ * \brief Runs one filter over many files without a user interface.
+ *
+ * Inputs are read on a separate thread pool while others are being filtered, so every worker has its next \
+ * input ready when it finishes the current one. At most PREFETCH inputs per worker are held in memory at a time. \
+ * The outputs are written in the same layout as the GUI saves them, so either can open what the other wrote. \
+ * Every input is first predicted by CostModel from its image header, so the longest start first and the \
+ * time and memory budgets of the options can be kept.
+ */
+class BatchRunner {
+public:
+    /*!
+     * \brief What to run and where to write the results.
+     */
+    struct Options {
+        QString operation; /*!< One of operations() */
+        QString output; /*!< The folder the results are written to */
+        int strength = 10; /*!< The block size for blur and deblur, 0 to detect it when deblurring */
+        QString base; /*!< The base image for encode, or the GIF for insert */
+        bool encrypted = false; /*!< Whether insert encodes the secret first, and extract decodes it after */
+        int jobs = 0; /*!< How many inputs are filtered at once, 0 for one per core */
+        QString format = "png"; /*!< The extension and format of the images written, "png", "qoi", "pam" or "planar" */
+        int maxTime = 0; /*!< The longest time in seconds an input is predicted to take and still be filtered, 0 for no limit */
+        int maxMemory = 0; /*!< The most memory in megabytes the inputs filtered at once are predicted to need, 0 for no limit */
+    };
+    explicit BatchRunner(const Options&);
+    static QStringList operations();
+    bool prepare(QString&);
+    QStringList collect(const QStringList&) const;
+    int run(const QStringList&);
+private:
+    /*!
+     * \brief Everything read from disk for one input, before it is filtered.
+     */
+    struct Input {
+        QString path; /*!< The file or folder given for this input */
+        QString name; /*!< The name the results are written under */
+        QImage image; /*!< The image to filter */
+        QImage red; /*!< The red residue, for deblur */
+        QImage green; /*!< The green residue, for deblur */
+        QImage blue; /*!< The blue residue, for deblur */
+        QVector<QPoint> tiles; /*!< The packed blocks listed in tiles.txt, for deblur */
+        int size = 0; /*!< The block size given by tiles.txt, for deblur */
+        QByteArray gif; /*!< The bytes of the GIF, for extract */
+        QString error; /*!< Why the input could not be read, or an empty string */
+    };
+    Input load(const QString&) const;
+    CostModel::Estimate estimate(const QString&) const;
+    QString process(const Input&) const;
+    QString blur(const Input&) const;
+    QString deblur(const Input&) const;
+    QString encode(const Input&) const;
+    QString decode(const Input&) const;
+    QString insert(const Input&) const;
+    QString extract(const Input&) const;
+    static bool isDeblurFolder(const QString&);
+    static QString readTiles(const QString&, int&, QVector<QPoint>&);
+    static const int PREFETCH; /*!< How many inputs per worker may be read ahead */
+    Options options; /*!< What to run and where */
+    QImage base; /*!< The base image for encode */
+    QByteArray baseGif; /*!< The bytes of the GIF for insert, shared by every input */
+    QAtomicInt failed; /*!< How many inputs have failed so far */
+};
+
+#endif // BATCHRUNNER_H
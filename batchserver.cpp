@@ -0,0 +1,473 @@
+#include "batchserver.h"
+#include "blurfilter.h"
+#include "deblurfilter.h"
+#include "decodefilter.h"
+#include "encodefilter.h"
+#include "imageio.h"
+#include "rawimage.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalSocket>
+#include <QThread>
+#include <QtConcurrent>
+#include <iterator>
+#include <limits>
+
+const int BatchServer::MAX_LINE = 1024 * 1024;
+
+const int BatchServer::MAX_BASES = 8;
+
+/*!
+ * \brief constructor: start the worker threads, without listening yet.
+ * \param jobCount How many jobs run at once, 0 for one per core
+ * \param parent The parent object
+ */
+BatchServer::BatchServer(int jobCount, QObject *parent) :
+        QObject(parent), jobs(jobCount > 0 ? jobCount : QThread::idealThreadCount()) {
+    workers.setMaxThreadCount(jobs);
+    workers.setExpiryTimeout(-1);
+    clock.start();
+    connect(&server, &QLocalServer::newConnection, this, [this]() {
+        while (QLocalSocket *socket = server.nextPendingConnection()) {
+            clients.insert(socket, "connection " + QString::number(++connections));
+            connect(socket, &QLocalSocket::readyRead, this, [this, socket]() {
+                receive(socket);
+            });
+            connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+                disconnected(socket);
+            });
+        }
+    });
+}
+
+/*!
+ * \brief destructor: wait for the running jobs and free the outputs nobody released.
+ */
+BatchServer::~BatchServer() {
+    workers.waitForDone();
+    for (const QHash<QString, QSharedMemory*> &outputs : segments) {
+        qDeleteAll(outputs);
+    }
+}
+
+/*!
+ * \brief The operations the server runs. Inserting and extracting need a GIF, which the batch mode handles.
+ * \return The names of the operations
+ */
+QStringList BatchServer::operations() {
+    return QStringList{"blur", "deblur", "encode", "decode"};
+}
+
+/*!
+ * \brief Start accepting clients, then run one small job on every worker so that the first client does not wait for them.
+ *
+ * Only the user running the server may connect. A socket left behind by a server that did not stop cleanly \
+ * is replaced; one a server still answers on is not.
+ *
+ * \param name The name of the socket, e.g. "h22" for /tmp/h22 on Unix, or a full path
+ * \param error Set to why the server cannot listen, if it cannot
+ * \return Whether it listens
+ */
+bool BatchServer::listen(const QString &name, QString &error) {
+    server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (!server.listen(name) && server.serverError() == QAbstractSocket::AddressInUseError) {
+        QLocalSocket probe;
+        probe.connectToServer(name);
+        if (probe.waitForConnected(1000)) {
+            error = "Another server is already listening on " + name;
+            return false;
+        }
+        QLocalServer::removeServer(name);
+        server.listen(name);
+    }
+    if (!server.isListening()) {
+        error = server.errorString();
+        return false;
+    }
+    warmUp();
+    return true;
+}
+
+/*!
+ * \brief Start every worker thread and run the filter code once on each, while no client is waiting.
+ */
+void BatchServer::warmUp() {
+    for (int i = 0; i < jobs; i++) {
+        QtConcurrent::run(&workers, [i]() {
+            QImage image(64, 64, QImage::Format_RGB32);
+            image.fill(qRgb(i % 256, 128, 128)); // a different image each, so the result cache does not answer
+            DecodeFilter filter;
+            filter.setImage(image);
+            filter.apply();
+        });
+    }
+    workers.waitForDone();
+}
+
+/*!
+ * \brief Read the complete request lines a client has sent, and queue their jobs.
+ *
+ * A line {"release": key} frees the shared memory of an output the client has read. \
+ * A client sending a line longer than MAX_LINE is disconnected.
+ *
+ * \param socket The client
+ */
+void BatchServer::receive(QLocalSocket *socket) {
+    if (!clients.contains(socket)) {
+        return; // disconnected, waiting to be deleted
+    }
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+        if (!document.isObject()) {
+            send(socket, QJsonObject{{"error", "Not a JSON object: " + parseError.errorString()}});
+            continue;
+        }
+        QJsonObject request = document.object();
+        if (request.contains("release")) {
+            delete segments[socket].take(request.value("release").toString());
+            continue;
+        }
+        QString operation = request.value("operation").toString();
+        if (!operations().contains(operation)) {
+            send(socket, QJsonObject{{"id", request.value("id")},
+                    {"error", "Unknown operation \"" + operation + "\", expected one of " + operations().join(", ")}});
+            continue;
+        }
+        Job job;
+        job.socket = socket;
+        job.request = request;
+        job.client = request.value("client").toString(clients.value(socket));
+        job.priority = request.value("priority").toInt();
+        job.received = clock.elapsed();
+        enqueue(job);
+    }
+    if (socket->bytesAvailable() > MAX_LINE) {
+        send(socket, QJsonObject{{"error", "Request longer than " + QString::number(MAX_LINE) + " bytes"}});
+        socket->disconnectFromServer();
+    }
+    dispatch();
+}
+
+/*!
+ * \brief Queue a job behind the other jobs of its client and priority.
+ * \param job The job
+ */
+void BatchServer::enqueue(const Job &job) {
+    Lane &lane = lanes[job.priority];
+    QQueue<Job> &queue = lane.jobs[job.client];
+    if (queue.isEmpty()) {
+        lane.turns.append(job.client);
+    }
+    queue.enqueue(job);
+}
+
+/*!
+ * \brief Take the next job to run: from the highest priority, of the client whose turn it is.
+ *
+ * The client then goes to the back of the turns if it has more jobs queued. \
+ * Jobs of clients that have disconnected are dropped.
+ *
+ * \param job Set to the job
+ * \return Whether there was a job
+ */
+bool BatchServer::dequeue(Job &job) {
+    while (!lanes.isEmpty()) {
+        QMap<int, Lane>::iterator highest = std::prev(lanes.end());
+        Lane &lane = highest.value();
+        QString client = lane.turns.takeFirst();
+        QQueue<Job> &queue = lane.jobs[client];
+        job = queue.dequeue();
+        if (queue.isEmpty()) {
+            lane.jobs.remove(client);
+        } else {
+            lane.turns.append(client);
+        }
+        if (lane.turns.isEmpty()) {
+            lanes.erase(highest);
+        }
+        if (!job.socket.isNull() && clients.contains(job.socket)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*!
+ * \brief Start queued jobs on the workers until as many as jobs are running.
+ */
+void BatchServer::dispatch() {
+    Job job;
+    while (running < jobs && dequeue(job)) {
+        running++;
+        QFutureWatcher<Result> *watcher = new QFutureWatcher<Result>(this);
+        connect(watcher, &QFutureWatcher<Result>::finished, this, [this, watcher, job]() {
+            running--;
+            finish(job, watcher->result());
+            watcher->deleteLater();
+            dispatch();
+        });
+        watcher->setFuture(QtConcurrent::run(&workers, [this, job]() {
+            return execute(job);
+        }));
+    }
+}
+
+/*!
+ * \brief Send the reply of a finished job, and keep its outputs until the client releases them.
+ * \param job The job
+ * \param result What it gave back
+ */
+void BatchServer::finish(const Job &job, const Result &result) {
+    if (job.socket.isNull() || !clients.contains(job.socket)) { // gone, or going once deleteLater() runs
+        qDeleteAll(result.segments);
+        return;
+    }
+    for (QSharedMemory *segment : result.segments) {
+        segments[job.socket].insert(segment->nativeKey(), segment);
+    }
+    send(job.socket, result.reply);
+}
+
+/*!
+ * \brief Forget a client that has gone, with its queued jobs and the outputs it did not release.
+ *
+ * It is taken out of clients at once, so that jobs finishing before the socket is deleted free their outputs.
+ *
+ * \param socket The client
+ */
+void BatchServer::disconnected(QLocalSocket *socket) {
+    qDeleteAll(segments.take(socket));
+    clients.remove(socket);
+    socket->deleteLater(); // clears the sockets of its jobs, so dequeue() drops them and finish() sends nothing
+}
+
+/*!
+ * \brief Send one reply line to a client, at once.
+ * \param socket The client
+ * \param reply The reply
+ */
+void BatchServer::send(QLocalSocket *socket, const QJsonObject &reply) {
+    socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact) + '\n');
+    socket->flush();
+}
+
+/*!
+ * \brief Run one job on a worker and make its reply.
+ *
+ * The reply holds the id of the request, then either "error" or "outputs", and how long the job waited \
+ * in the queue ("queued") and ran ("milliseconds").
+ *
+ * \param job The job
+ * \return The reply and the shared memory holding the outputs
+ */
+BatchServer::Result BatchServer::execute(const Job &job) {
+    qint64 started = clock.elapsed();
+    Result result;
+    QVector<QPair<QString, QImage>> images;
+    QString error = process(job.request, images);
+    QJsonObject paths = job.request.value("outputs").toObject();
+    QJsonObject outputs;
+    for (int i = 0; i < images.size() && error.isEmpty(); i++) {
+        outputs.insert(images[i].first, output(images[i].second, paths.value(images[i].first).toString(),
+                result.segments, error));
+    }
+    result.reply.insert("id", job.request.value("id"));
+    if (error.isEmpty()) {
+        result.reply.insert("outputs", outputs);
+        for (QSharedMemory *segment : result.segments) {
+            segment->moveToThread(thread()); // finish() keeps them on the thread of the server
+        }
+    } else {
+        result.reply.insert("error", error);
+        qDeleteAll(result.segments);
+        result.segments.clear();
+    }
+    result.reply.insert("queued", static_cast<double>(started - job.received));
+    result.reply.insert("milliseconds", static_cast<double>(clock.elapsed() - started));
+    return result;
+}
+
+/*!
+ * \brief Read the inputs of a request and run its filter, like the batch mode does for one input.
+ * \param request The request
+ * \param images Set to the named outputs: image, and red, green and blue for blur
+ * \return Why it failed, or an empty string
+ */
+QString BatchServer::process(const QJsonObject &request, QVector<QPair<QString, QImage>> &images) {
+    QString operation = request.value("operation").toString();
+    QJsonObject inputs = request.value("inputs").toObject();
+    int strength = request.value("strength").toInt(operation == "deblur" ? 0 : 10);
+    if (strength != 10 && strength != 16 && strength != 20 && !(strength == 0 && operation == "deblur")) {
+        return "The strength must be 10, 16 or 20, or 0 to detect it when deblurring";
+    }
+    QString error;
+    QImage image = input(inputs.value("image"), error);
+    if (!error.isEmpty()) {
+        return error;
+    }
+
+    if (operation == "blur") {
+        BlurFilter filter;
+        filter.setImage(image);
+        filter.setSize(strength);
+        filter.apply();
+        images = {qMakePair(QString("image"), filter.getImage()), qMakePair(QString("red"), filter.getRedResidue()),
+                qMakePair(QString("green"), filter.getGreenResidue()), qMakePair(QString("blue"), filter.getBlueResidue())};
+    } else if (operation == "deblur") {
+        QImage red = input(inputs.value("red"), error);
+        QImage green = error.isEmpty() ? input(inputs.value("green"), error) : QImage();
+        QImage blue = error.isEmpty() ? input(inputs.value("blue"), error) : QImage();
+        if (!error.isEmpty()) {
+            return error;
+        }
+        // The packed blocks, as listed by tiles.txt in the folders written by blurring
+        QVector<QPoint> tiles;
+        for (const QJsonValue &tile : request.value("tiles").toArray()) {
+            QPoint corner(tile.toArray().at(0).toInt(-1), tile.toArray().at(1).toInt(-1));
+            if (strength == 0 || !image.rect().contains(corner) || corner.x() % strength != 0 || corner.y() % strength != 0) {
+                return "The tiles must be block corners inside the image, with the strength given";
+            }
+            tiles.append(corner);
+        }
+        DeblurFilter filter;
+        filter.setImage(image, red, green, blue);
+        filter.setTiles(tiles);
+        filter.setSize(strength != 0 ? strength : filter.detectSize(QVector<int>{10, 16, 20}));
+        filter.apply();
+        if (!filter.getError().isEmpty()) {
+            return filter.getError();
+        }
+        images = {qMakePair(QString("image"), filter.getImage())};
+    } else if (operation == "encode") {
+        QImage baseImage = inputs.contains("base") ? input(inputs.value("base"), error) : base(request.value("base").toString());
+        if (baseImage.isNull()) {
+            return error.isEmpty() ? "Encoding needs a base image, given with \"base\"" : error;
+        }
+        EncodeFilter filter;
+        filter.setImage(baseImage);
+        filter.setSecret(image);
+        filter.apply();
+        images = {qMakePair(QString("image"), filter.getImage())};
+    } else {
+        DecodeFilter filter;
+        filter.setImage(image);
+        filter.apply();
+        images = {qMakePair(QString("image"), filter.getImage())};
+    }
+    return QString();
+}
+
+/*!
+ * \brief Read one input image, from shared memory or from a file.
+ *
+ * The image is copied out of shared memory and the segment detached at once, so that no image the filters \
+ * or their result cache keep refers to memory the client may reuse. The filters copy every image into their \
+ * own planes anyway, so the copy is small next to the filter.
+ *
+ * \param value {"shm": native key of a segment holding a PAM, PPM or PGM file} or {"path": file}
+ * \param error Set to why it cannot be read, if it cannot
+ * \return The image, or a null image
+ */
+QImage BatchServer::input(const QJsonValue &value, QString &error) const {
+    QJsonObject source = value.toObject();
+    if (source.contains("path")) {
+        QString path = source.value("path").toString();
+        QImage image = imageio::read(path);
+        if (image.isNull()) {
+            error = "Cannot read " + path;
+        }
+        return image;
+    }
+    QString key = source.value("shm").toString();
+    QSharedMemory segment;
+    segment.setNativeKey(key);
+    if (key.isEmpty() || !segment.attach(QSharedMemory::ReadOnly)) {
+        error = "Cannot attach the shared memory \"" + key + "\" of an input";
+        return QImage();
+    }
+    QImage image = rawimage::fromData(static_cast<const uchar*>(segment.constData()), segment.size()).copy();
+    if (image.isNull()) {
+        error = "The shared memory \"" + key + "\" does not hold an 8-bit PAM, PPM or PGM image";
+    }
+    return image;
+}
+
+/*!
+ * \brief Hand one output image to the client, in a new shared memory segment or in a file.
+ *
+ * Segments are written as PAM and named after the process and a counter. On Unix the native key of a \
+ * segment is the path of the file its System V key is made from.
+ *
+ * \param image The image
+ * \param path The file to write it to, or an empty string for shared memory
+ * \param created The segment is added to it
+ * \param error Set to why it cannot be handed over, if it cannot
+ * \return {"shm": native key, "bytes": size of the PAM} or {"path": file}
+ */
+QJsonValue BatchServer::output(const QImage &image, const QString &path, QVector<QSharedMemory*> &created, QString &error) {
+    if (!path.isEmpty()) {
+        if (!imageio::write(image, path)) {
+            error = "Cannot write " + path;
+        }
+        return QJsonObject{{"path", path}};
+    }
+    QString name = QString("h22batch-%1-%2").arg(QCoreApplication::applicationPid()).arg(outputCount.fetchAndAddRelaxed(1));
+#ifdef Q_OS_WIN
+    QString key = name;
+#else
+    QString key = QDir::temp().filePath(name);
+#endif
+    qint64 size = rawimage::dataSize(image);
+    QSharedMemory *segment = new QSharedMemory();
+    segment->setNativeKey(key);
+    if (size == 0 || size > std::numeric_limits<int>::max() || !segment->create(static_cast<int>(size))) {
+        error = "Cannot create shared memory for an output: " + segment->errorString();
+        delete segment;
+        return QJsonValue();
+    }
+    rawimage::toData(image, static_cast<uchar*>(segment->data()), segment->size());
+    created.append(segment);
+    return QJsonObject{{"shm", key}, {"bytes", static_cast<double>(size)}};
+}
+
+/*!
+ * \brief The base image of encode at a path, read once and kept while it is among the MAX_BASES used last.
+ *
+ * A base whose file has changed since it was read is read again.
+ *
+ * \param path The file
+ * \return The image, or a null image if it cannot be read
+ */
+QImage BatchServer::base(const QString &path) {
+    QString key = path + "|" + QString::number(QFileInfo(path).lastModified().toMSecsSinceEpoch());
+    QMutexLocker locker(&basesMutex);
+    if (bases.contains(key)) {
+        baseOrder.removeOne(key);
+        baseOrder.append(key);
+        return bases.value(key);
+    }
+    locker.unlock();
+    QImage image = imageio::read(path);
+    if (image.isNull()) {
+        return image;
+    }
+    locker.relock();
+    if (!bases.contains(key)) {
+        bases.insert(key, image);
+        baseOrder.append(key);
+    }
+    while (baseOrder.size() > MAX_BASES) {
+        bases.remove(baseOrder.takeFirst());
+    }
+    return image;
+}
@@ -0,0 +1,101 @@
+#ifndef BATCHSERVER_H
+#define BATCHSERVER_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QImage>
+#include <QJsonObject>
+#include <QLocalServer>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QQueue>
+#include <QSharedMemory>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+class QLocalSocket;
+
+/*!
+ * \brief Runs filters for other programs on this host, staying up between jobs so that none pays for starting.
+ *
+ * Clients connect to a local socket (a Unix domain socket, or a named pipe on Windows) and send one JSON \
+ * object per line; every job gets one JSON line back, in the order jobs finish. Images go both ways in shared \
+ * memory as PAM files (see rawimage), or as files. The worker threads, the result cache of the filters, \
+ * the cost model and the base images of encode stay warm from one job to the next. Queued jobs run by \
+ * priority, and jobs of the same priority take turns between clients, so one busy client cannot hold up the others.
+ */
+class BatchServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchServer(int jobs, QObject *parent = nullptr);
+    ~BatchServer();
+    bool listen(const QString&, QString&);
+    static QStringList operations();
+
+private:
+    /*!
+     * \brief One job waiting or running.
+     */
+    struct Job {
+        QPointer<QLocalSocket> socket; /*!< The client that sent it, cleared if it disconnects */
+        QJsonObject request; /*!< The request as sent */
+        QString client; /*!< Who the job is fair to, the "client" of the request or one per connection */
+        int priority = 0; /*!< Higher runs first */
+        qint64 received = 0; /*!< When it arrived, on clock */
+    };
+
+    /*!
+     * \brief What a job gives back, made on a worker thread.
+     */
+    struct Result {
+        QJsonObject reply; /*!< The line sent back */
+        QVector<QSharedMemory*> segments; /*!< The shared memory holding the outputs, kept until released */
+    };
+
+    /*!
+     * \brief The queued jobs of one priority, with the clients taking turns.
+     */
+    struct Lane {
+        QStringList turns; /*!< The clients with queued jobs, the next one to run first */
+        QHash<QString, QQueue<Job>> jobs; /*!< The queued jobs of every client, oldest first */
+    };
+
+    void receive(QLocalSocket*);
+    void enqueue(const Job&);
+    bool dequeue(Job&);
+    void dispatch();
+    void finish(const Job&, const Result&);
+    void disconnected(QLocalSocket*);
+    void send(QLocalSocket*, const QJsonObject&);
+    Result execute(const Job&);
+    QString process(const QJsonObject&, QVector<QPair<QString, QImage>>&);
+    QImage base(const QString&);
+    QImage input(const QJsonValue&, QString&) const;
+    QJsonValue output(const QImage&, const QString&, QVector<QSharedMemory*>&, QString&);
+    void warmUp();
+    static const int MAX_LINE; /*!< The longest request line accepted, in bytes */
+    static const int MAX_BASES; /*!< How many base images of encode are kept */
+    QLocalServer server; /*!< Accepts the clients */
+    QThreadPool workers; /*!< Runs the jobs; its threads are never retired, so they stay warm */
+    int jobs; /*!< How many jobs run at once */
+    int running = 0; /*!< How many jobs are running */
+    int connections = 0; /*!< Numbers the connections, to name their clients */
+    QMap<int, Lane> lanes; /*!< The queued jobs by priority, the highest last */
+    QHash<QLocalSocket*, QString> clients; /*!< The client name of every connection */
+    QHash<QLocalSocket*, QHash<QString, QSharedMemory*>> segments; /*!< The outputs of every connection not yet released */
+    QHash<QString, QImage> bases; /*!< The base images of encode, by path and modification time */
+    QStringList baseOrder; /*!< The keys of bases, least recently used first */
+    QMutex basesMutex; /*!< Guards bases and baseOrder, used by every worker */
+    QAtomicInt outputCount; /*!< Numbers the shared memory segments of the outputs */
+    QElapsedTimer clock; /*!< Times the jobs since the server started */
+};
+
+#endif // BATCHSERVER_H
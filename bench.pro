@@ -0,0 +1,28 @@
+# The benchmark tool: times the kernels, filters and GIF stages on synthetic images,
+# and with --roundtrip checks the accuracy, time and memory of every round trip.
+# Build it with: qmake bench.pro && make
+# Run it on an otherwise idle machine, with optimizations on (the default release build).
+
+QT = core gui concurrent
+
+CONFIG += c++11 console release
+CONFIG -= app_bundle
+
+TARGET = h22bench
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(filters.pri)
+
+SOURCES += \
+    benchmain.cpp \
+    benchmark.cpp \
+    imagemetrics.cpp \
+    roundtrip.cpp \
+    synthetic.cpp
+
+HEADERS += \
+    benchmark.h \
+    imagemetrics.h \
+    roundtrip.h \
+    synthetic.h
@@ -0,0 +1,115 @@
+/*!
+ * \brief The benchmark tool, timing the kernels and filters on synthetic images.
+ *
+ * Example: h22bench --sizes 64,256 --filter Blur --json results.json
+ *
+ * With --roundtrip, it instead checks that the round trips still give back their images within their \
+ * accuracy thresholds and budgets, and exits with 1 if any does not.
+ */
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <cstdio>
+#include "benchmark.h"
+#include "roundtrip.h"
+
+/*!
+ * \brief Parse a comma-separated list of positive numbers.
+ * \param text The list
+ * \param numbers Set to the numbers if they are all valid
+ * \return Whether they are all valid
+ */
+static bool parseList(const QString &text, QVector<int> &numbers) {
+    QVector<int> parsed;
+    for (const QString &item : text.split(',')) {
+        bool ok;
+        int number = item.trimmed().toInt(&ok);
+        if (!ok || number <= 0) {
+            return false;
+        }
+        parsed.append(number);
+    }
+    numbers = parsed;
+    return true;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setOrganizationName("H22");
+    QCoreApplication::setApplicationName("project_H22");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Times the kernels and filters of the Light-weight Image Encryptor on synthetic images.");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "The sides of the square images (default: 64,256,1024).", "list");
+    QCommandLineOption strengthsOption("strengths", "The block sizes (default: 10,16,20).", "list");
+    QCommandLineOption timeOption("min-time", "The least time each case runs for (default: 200).", "milliseconds");
+    QCommandLineOption filterOption("filter", "Only run the cases whose label matches, e.g. \"Gif|256x256\".", "regex");
+    QCommandLineOption jsonOption("json", "Write the results as JSON to a file, or - for the standard output.", "file");
+    QCommandLineOption roundTripOption("roundtrip", "Check the round trips instead of timing, exit with 1 if any fails.");
+    QCommandLineOption scaleOption("time-scale", "Stretch the time budgets of the round trips, e.g. 4 for debug builds (default: 1).", "factor");
+    parser.addOption(sizesOption);
+    parser.addOption(strengthsOption);
+    parser.addOption(timeOption);
+    parser.addOption(filterOption);
+    parser.addOption(jsonOption);
+    parser.addOption(roundTripOption);
+    parser.addOption(scaleOption);
+    parser.process(a);
+    QString json = parser.value(jsonOption);
+
+    if (parser.isSet(roundTripOption)) {
+        double scale = parser.isSet(scaleOption) ? parser.value(scaleOption).toDouble() : 1;
+        if (scale <= 0) {
+            fprintf(stderr, "The time scale must be a positive number\n");
+            return 2;
+        }
+        QVector<RoundTrip::Result> results = RoundTrip(scale).run();
+        if (json == "-") {
+            printf("%s", RoundTrip::toJson(results).toJson().constData());
+        } else {
+            printf("%s", qPrintable(RoundTrip::toTable(results)));
+            QFile file(json);
+            if (!json.isEmpty() && (!file.open(QIODevice::WriteOnly) || file.write(RoundTrip::toJson(results).toJson()) < 0)) {
+                fprintf(stderr, "Cannot write %s\n", qPrintable(json));
+            }
+        }
+        for (const RoundTrip::Result &result : results) {
+            if (!result.failure().isEmpty()) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    Benchmark::Options options;
+    if ((parser.isSet(sizesOption) && !parseList(parser.value(sizesOption), options.sizes))
+            || (parser.isSet(strengthsOption) && !parseList(parser.value(strengthsOption), options.strengths))) {
+        fprintf(stderr, "The sizes and strengths must be lists of positive numbers, e.g. 64,256\n");
+        return 2;
+    }
+    if (parser.isSet(timeOption)) {
+        options.minTime = parser.value(timeOption).toInt();
+    }
+    options.filter = QRegularExpression(parser.value(filterOption));
+    if (!options.filter.isValid()) {
+        fprintf(stderr, "Invalid filter: %s\n", qPrintable(options.filter.errorString()));
+        return 2;
+    }
+
+    QVector<Benchmark::Result> results = Benchmark(options).run();
+    if (json == "-") {
+        printf("%s", Benchmark::toJson(results).toJson().constData());
+    } else {
+        printf("%s", qPrintable(Benchmark::toTable(results)));
+        if (!json.isEmpty()) {
+            QFile file(json);
+            if (!file.open(QIODevice::WriteOnly) || file.write(Benchmark::toJson(results).toJson()) < 0) {
+                fprintf(stderr, "Cannot write %s\n", qPrintable(json));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,464 @@
+#include "benchmark.h"
+#include "blurfilter.h"
+#include "deblurfilter.h"
+#include "decodefilter.h"
+#include "encodefilter.h"
+#include "extractfilter.h"
+#include "gif.h"
+#include "insertfilter.h"
+#include "math.h"
+#include "matrix.h"
+#include "qoicodec.h"
+#include "rawimage.h"
+#include "synthetic.h"
+#include <QBuffer>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QMovie>
+#include <QSysInfo>
+#include <QTemporaryDir>
+#include <QThread>
+#include <cstdio>
+#include <cstring>
+
+const int Benchmark::DEBLUR_MAX_SIDE = 128;
+
+/*!
+ * \brief The label of a case, as matched by Options::filter and shown in the table.
+ * \return e.g. "matrix::blurMatrix 256x256 high s10"
+ */
+QString Benchmark::Result::label() const {
+    QString text = name + " " + QString::number(width) + "x" + QString::number(height);
+    if (!entropy.isEmpty()) {
+        text += " " + entropy;
+    }
+    if (strength != 0) {
+        text += " s" + QString::number(strength);
+    }
+    return text;
+}
+
+/*!
+ * \brief The throughput of a case.
+ * \return Megapixels per second
+ */
+double Benchmark::Result::throughput() const {
+    return seconds > 0 ? pixels / seconds / 1e6 : 0;
+}
+
+/*!
+ * \brief constructor: remember which cases to run.
+ * \param opts Which cases to run and for how long
+ */
+Benchmark::Benchmark(const Options &opts) :
+        options(opts) {
+}
+
+/*!
+ * \brief Run every case that matches the options, printing each one on the standard error as it finishes.
+ * \return The timings
+ */
+QVector<Benchmark::Result> Benchmark::run() {
+    results.clear();
+    solver();
+    for (int size : options.sizes) {
+        for (synthetic::Entropy entropy : synthetic::entropies()) {
+            QImage img = synthetic::image(size, size, entropy);
+            kernels(img, synthetic::name(entropy));
+            filters(img, synthetic::name(entropy));
+            gifStages(img, synthetic::name(entropy));
+            codecs(img, synthetic::name(entropy));
+        }
+    }
+    return results;
+}
+
+/*!
+ * \brief Time one case.
+ * \param name The function or filter timed
+ * \param width The width of the image
+ * \param height The height of the image
+ * \param entropy The entropy level of the image, empty if it does not matter
+ * \param strength The block size, 0 if it does not matter
+ * \param body One iteration, returning how many pixels it processed
+ */
+void Benchmark::measure(const QString &name, int width, int height, const QString &entropy, int strength,
+        const std::function<qint64()> &body) {
+    Result result{name, width, height, entropy, strength, 0, 0, 0};
+    if (!options.filter.pattern().isEmpty() && !options.filter.match(result.label()).hasMatch()) {
+        return;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    qint64 pixels = 0;
+    do {
+        pixels += body();
+        result.iterations++;
+    } while (timer.elapsed() < options.minTime);
+    result.seconds = timer.nsecsElapsed() / 1e9;
+    result.pixels = pixels;
+    results.append(result);
+    fprintf(stderr, "%-48s %10.3f MP/s\n", qPrintable(result.label()), result.throughput());
+}
+
+/*!
+ * \brief Copy one color channel of an image into a new matrix, as the filters do.
+ * \param img The image
+ * \param shift 16 for red, 8 for green, 0 for blue
+ * \return The matrix, to be freed with release()
+ */
+double **Benchmark::channel(const QImage &img, int shift) {
+    double **m = new double*[img.height()];
+    for (int i = 0; i < img.height(); i++) {
+        m[i] = new double[img.width()];
+        for (int j = 0; j < img.width(); j++) {
+            m[i][j] = (img.pixel(j, i) >> shift) & 0xFF;
+        }
+    }
+    return m;
+}
+
+/*!
+ * \brief Free a matrix made by channel().
+ * \param m The matrix
+ * \param rows The number of rows
+ */
+void Benchmark::release(double **m, int rows) {
+    for (int i = 0; i < rows; i++) {
+        delete[] m[i];
+    }
+    delete[] m;
+}
+
+/*!
+ * \brief Time the block kernels and the bit operations of encoding.
+ *
+ * The block kernels go through the blocks of the image one call at a time, starting over at the end. \
+ * The system deblurMatrix solves only depends on the shape of the block, so its values do not change the time.
+ *
+ * \param img The image
+ * \param entropy The name of its entropy level
+ */
+void Benchmark::kernels(const QImage &img, const QString &entropy) {
+    int h = img.height();
+    int w = img.width();
+    for (int s : options.strengths) {
+        int blockRows = (h + s - 1) / s;
+        int blockColumns = (w + s - 1) / s;
+        double **m = channel(img, 16);
+        int block = 0;
+        auto nextBlock = [&](void (*kernel)(double**, int, int, int, int, int)) -> qint64 {
+            int x = block / blockColumns * s;
+            int y = block % blockColumns * s;
+            block = (block + 1) % (blockRows * blockColumns);
+            kernel(m, h, w, x, y, s);
+            return static_cast<qint64>(qMin(s, h - x)) * qMin(s, w - y);
+        };
+        measure("matrix::blurMatrix", w, h, entropy, s, [&]() { return nextBlock(matrix::blurMatrix); });
+        block = 0;
+        measure("matrix::deblurMatrix", w, h, entropy, s, [&]() { return nextBlock(matrix::deblurMatrix); });
+        release(m, h);
+    }
+
+    // The low four bits of every channel, as encoding and decoding use them
+    QVector<int> to(w * h * 3);
+    QVector<int> from(w * h * 3);
+    QImage secret = synthetic::image(w, h, synthetic::High, 2);
+    for (int i = 0; i < h; i++) {
+        for (int j = 0; j < w; j++) {
+            QRgb a = img.pixel(j, i);
+            QRgb b = secret.pixel(j, i);
+            int k = (i * w + j) * 3;
+            to[k] = qRed(a);
+            to[k + 1] = qGreen(a);
+            to[k + 2] = qBlue(a);
+            from[k] = qRed(b);
+            from[k + 1] = qGreen(b);
+            from[k + 2] = qBlue(b);
+        }
+    }
+    measure("math::insert", w, h, entropy, 0, [&]() -> qint64 {
+        for (int k = 0; k < to.size(); k++) {
+            math::insert(to[k], from[k]);
+        }
+        return static_cast<qint64>(w) * h;
+    });
+    measure("math::extract", w, h, entropy, 0, [&]() -> qint64 {
+        for (int k = 0; k < to.size(); k++) {
+            from[k] = math::extract(to[k]);
+        }
+        return static_cast<qint64>(w) * h;
+    });
+}
+
+/*!
+ * \brief Time math::rref on systems as large as the ones a block of every strength needs.
+ *
+ * The systems are random but diagonally dominant, so they have a unique solution like the deblurring ones.
+ */
+void Benchmark::solver() {
+    for (int s : options.strengths) {
+        int n = s * s;
+        quint64 state = 1;
+        QVector<double> coefficients(n * (n + 1));
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j <= n; j++) {
+                state = state * Q_UINT64_C(6364136223846793005) + Q_UINT64_C(1442695040888963407);
+                coefficients[i * (n + 1) + j] = (state >> 40) / double(1 << 24) + (i == j ? n : 0);
+            }
+        }
+        double **a = new double*[n];
+        for (int i = 0; i < n; i++) {
+            a[i] = new double[n + 1];
+        }
+        measure("math::rref", s, s, QString(), s, [&]() -> qint64 {
+            for (int i = 0; i < n; i++) {
+                memcpy(a[i], coefficients.constData() + i * (n + 1), (n + 1) * sizeof(double));
+            }
+            math::rref(a, n, n + 1);
+            return n;
+        });
+        release(a, n);
+    }
+}
+
+/*!
+ * \brief Time apply() of every filter, with the result cache turned off so every iteration does the work.
+ *
+ * The whole deblur filter is only timed on images up to DEBLUR_MAX_SIDE; matrix::deblurMatrix covers larger ones.
+ *
+ * \param img The image
+ * \param entropy The name of its entropy level
+ */
+void Benchmark::filters(const QImage &img, const QString &entropy) {
+    int h = img.height();
+    int w = img.width();
+    qint64 pixels = static_cast<qint64>(w) * h;
+    BaseFilter::resultCache().setEnabled(false);
+
+    for (int s : options.strengths) {
+        BlurFilter blurred;
+        blurred.setImage(img);
+        blurred.setSize(s);
+        measure("BlurFilter::apply", w, h, entropy, s, [&]() -> qint64 {
+            blurred.setImage(img);
+            blurred.apply();
+            return pixels;
+        });
+        if (qMax(w, h) > DEBLUR_MAX_SIDE) {
+            continue;
+        }
+        blurred.setImage(img);
+        blurred.apply();
+        measure("DeblurFilter::apply", w, h, entropy, s, [&]() -> qint64 {
+            DeblurFilter filter;
+            filter.setImage(blurred.getImage(), blurred.getRedResidue(), blurred.getGreenResidue(), blurred.getBlueResidue());
+            filter.setSize(s);
+            filter.apply();
+            return pixels;
+        });
+    }
+
+    QImage secret = synthetic::image(w, h, synthetic::High, 2);
+    EncodeFilter encoder;
+    measure("EncodeFilter::apply", w, h, entropy, 0, [&]() -> qint64 {
+        encoder.setImage(img);
+        encoder.setSecret(secret);
+        encoder.apply();
+        return pixels;
+    });
+    QImage cipher = encoder.getImage();
+    measure("DecodeFilter::apply", w, h, entropy, 0, [&]() -> qint64 {
+        DecodeFilter decoder;
+        decoder.setImage(cipher);
+        decoder.apply();
+        return pixels;
+    });
+
+    // A five-frame GIF of the same size to insert into, then the GIF that insert wrote to extract from
+    QTemporaryDir dir;
+    QString base = dir.filePath("base.gif");
+    QString inserted = dir.filePath("inserted.gif");
+    GifWriter writer;
+    GifBegin(&writer, QFile::encodeName(base).constData(), w, h, 10);
+    for (int k = 0; k < 5; k++) {
+        QImage frame = synthetic::image(w, h, synthetic::Medium, 10 + k).convertToFormat(QImage::Format_RGBA8888);
+        GifWriteFrame(&writer, frame.constBits(), w, h, 10);
+    }
+    GifEnd(&writer);
+    measure("InsertFilter::apply", w, h, entropy, 0, [&]() -> qint64 {
+        QMovie movie(base);
+        InsertFilter filter;
+        filter.setMovie(&movie);
+        filter.setImage(img);
+        filter.setDestination(inserted);
+        filter.apply();
+        return pixels;
+    });
+    measure("ExtractFilter::apply", w, h, entropy, 0, [&]() -> qint64 {
+        QMovie movie(inserted);
+        ExtractFilter filter;
+        filter.setMovie(&movie);
+        filter.apply();
+        return pixels;
+    });
+    BaseFilter::resultCache().setEnabled(true);
+}
+
+/*!
+ * \brief Time the stages gif.cpp puts every frame through: palette, thresholding or dithering, then LZW.
+ * \param img The image
+ * \param entropy The name of its entropy level
+ */
+void Benchmark::gifStages(const QImage &img, const QString &entropy) {
+    int h = img.height();
+    int w = img.width();
+    qint64 pixels = static_cast<qint64>(w) * h;
+    QImage rgba = img.convertToFormat(QImage::Format_RGBA8888);
+    QVector<uint8_t> out(w * h * 4);
+    GifPalette palette;
+
+    measure("GifMakePalette", w, h, entropy, 0, [&]() -> qint64 {
+        GifMakePalette(nullptr, rgba.constBits(), w, h, 8, false, &palette);
+        return pixels;
+    });
+    measure("GifThresholdImage", w, h, entropy, 0, [&]() -> qint64 {
+        GifThresholdImage(nullptr, rgba.constBits(), out.data(), w, h, &palette);
+        return pixels;
+    });
+    GifPalette ditherPalette;
+    GifMakePalette(nullptr, rgba.constBits(), w, h, 8, true, &ditherPalette);
+    measure("GifDitherImage", w, h, entropy, 0, [&]() -> qint64 {
+        GifDitherImage(nullptr, rgba.constBits(), out.data(), w, h, &ditherPalette);
+        return pixels;
+    });
+
+    // Compress the thresholded frame into a scratch file, starting over every iteration so it stays small
+    GifThresholdImage(nullptr, rgba.constBits(), out.data(), w, h, &palette);
+    FILE *f = tmpfile();
+    if (f == nullptr) {
+        return;
+    }
+    measure("GifWriteLzwImage", w, h, entropy, 0, [&]() -> qint64 {
+        rewind(f);
+        GifWriteLzwImage(f, out.data(), 0, 0, w, h, 10, &palette);
+        return pixels;
+    });
+    fclose(f);
+}
+
+/*!
+ * \brief Time writing and reading an image in memory as PNG, at the default and the fastest zlib level, and as QOI, \
+ * and in a temporary file as PAM and planar PAM.
+ *
+ * The sizes of the files are printed on the standard error, to compare how well each compresses. \
+ * PAM files are mapped, so reading them touches every row too, as the filters do when they unpack the image.
+ *
+ * \param img The image
+ * \param entropy The name of its entropy level
+ */
+void Benchmark::codecs(const QImage &img, const QString &entropy) {
+    int h = img.height();
+    int w = img.width();
+    qint64 pixels = static_cast<qint64>(w) * h;
+    QByteArray png;
+    QByteArray fastPng;
+    for (int quality : {-1, 89}) { // 89 is zlib level 1, as imageio::Fast
+        QByteArray &bytes = quality < 0 ? png : fastPng;
+        measure(quality < 0 ? "png write" : "png write fast", w, h, entropy, 0, [&]() -> qint64 {
+            bytes.clear();
+            QBuffer buffer(&bytes);
+            buffer.open(QIODevice::WriteOnly);
+            QImageWriter writer(&buffer, "png");
+            writer.setQuality(quality);
+            writer.write(img);
+            return pixels;
+        });
+    }
+    measure("png read", w, h, entropy, 0, [&]() -> qint64 {
+        QBuffer buffer(&png);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader(&buffer, "png").read();
+        return pixels;
+    });
+    QByteArray qoi = qoicodec::encode(img);
+    measure("qoi write", w, h, entropy, 0, [&]() -> qint64 {
+        qoi = qoicodec::encode(img);
+        return pixels;
+    });
+    measure("qoi read", w, h, entropy, 0, [&]() -> qint64 {
+        qoicodec::decode(qoi);
+        return pixels;
+    });
+    QTemporaryDir dir;
+    for (const QString &suffix : {QString("pam"), QString("planar")}) {
+        QString file = dir.filePath("image." + suffix);
+        measure(suffix + " write", w, h, entropy, 0, [&]() -> qint64 {
+            rawimage::write(img, file);
+            return pixels;
+        });
+        measure(suffix + " read", w, h, entropy, 0, [&]() -> qint64 {
+            QImage image = rawimage::read(file);
+            volatile uchar sink = 0;
+            for (int i = 0; i < image.height(); i++) {
+                sink += image.constScanLine(i)[0];
+            }
+            return pixels;
+        });
+    }
+    if (!png.isEmpty()) {
+        fprintf(stderr, "%-48s png %d, png fast %d, qoi %d bytes\n",
+                qPrintable("codec sizes " + QString::number(w) + "x" + QString::number(h) + " " + entropy),
+                png.size(), fastPng.size(), qoi.size());
+    }
+}
+
+/*!
+ * \brief Put timings in a JSON document, with what is needed to compare runs on different machines and builds.
+ * \param results The timings
+ * \return The document
+ */
+QJsonDocument Benchmark::toJson(const QVector<Result> &results) {
+    QJsonArray cases;
+    for (const Result &result : results) {
+        QJsonObject item;
+        item["name"] = result.name;
+        item["width"] = result.width;
+        item["height"] = result.height;
+        item["entropy"] = result.entropy;
+        item["strength"] = result.strength;
+        item["iterations"] = result.iterations;
+        item["seconds"] = result.seconds;
+        item["megapixels_per_second"] = result.throughput();
+        cases.append(item);
+    }
+    QJsonObject root;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qt"] = QString(qVersion());
+    root["cpu"] = QSysInfo::currentCpuArchitecture();
+    root["abi"] = QSysInfo::buildAbi();
+    root["threads"] = QThread::idealThreadCount();
+    root["results"] = cases;
+    return QJsonDocument(root);
+}
+
+/*!
+ * \brief Put timings in a table for people to read.
+ * \param results The timings
+ * \return One line per case
+ */
+QString Benchmark::toTable(const QVector<Result> &results) {
+    QString table = QString("case").leftJustified(48) + QString("iterations").rightJustified(12)
+            + QString("MP/s").rightJustified(12) + "\n";
+    for (const Result &result : results) {
+        table += result.label().leftJustified(48) + QString::number(result.iterations).rightJustified(12)
+                + QString::number(result.throughput(), 'f', 3).rightJustified(12) + "\n";
+    }
+    return table;
+}
@@ -0,0 +1,63 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QImage>
+#include <QJsonDocument>
+#include <QRegularExpression>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+/*!
+ * \brief Times the kernels, the filters, the GIF encoder stages and the image codecs on synthetic images.
+ *
+ * Every case runs again and again until it has taken at least the minimum time, so short kernels are \
+ * timed over many calls and long filters over at least one. Throughput is reported in megapixels of \
+ * the image processed per second; for the block kernels, in megapixels of the blocks processed.
+ */
+class Benchmark {
+public:
+    /*!
+     * \brief Which cases to run and for how long.
+     */
+    struct Options {
+        QVector<int> sizes{64, 256, 1024}; /*!< The widths and heights of the synthetic images */
+        QVector<int> strengths{10, 16, 20}; /*!< The block sizes for blurring and deblurring */
+        int minTime = 200; /*!< The least time in milliseconds each case runs for */
+        QRegularExpression filter; /*!< Only the cases whose label matches are run, all if it is empty */
+    };
+
+    /*!
+     * \brief The timing of one case.
+     */
+    struct Result {
+        QString name; /*!< The function or filter timed */
+        int width; /*!< The width of the image */
+        int height; /*!< The height of the image */
+        QString entropy; /*!< The entropy level of the image, empty if it does not matter */
+        int strength; /*!< The block size, 0 if it does not matter */
+        int iterations; /*!< How many times the case ran */
+        double seconds; /*!< The total time of all iterations */
+        double pixels; /*!< The total pixels processed by all iterations */
+        QString label() const;
+        double throughput() const;
+    };
+    explicit Benchmark(const Options&);
+    QVector<Result> run();
+    static QJsonDocument toJson(const QVector<Result>&);
+    static QString toTable(const QVector<Result>&);
+private:
+    void measure(const QString&, int, int, const QString&, int, const std::function<qint64()>&);
+    void kernels(const QImage&, const QString&);
+    void solver();
+    void filters(const QImage&, const QString&);
+    void gifStages(const QImage&, const QString&);
+    void codecs(const QImage&, const QString&);
+    static double **channel(const QImage&, int);
+    static void release(double**, int);
+    static const int DEBLUR_MAX_SIDE; /*!< The largest image the whole deblur filter is timed on, it is far slower than the rest */
+    Options options; /*!< Which cases to run */
+    QVector<Result> results; /*!< The cases run so far */
+};
+
+#endif // BENCHMARK_H
@@ -1,4 +1,5 @@
 #include "blurfilter.h"
+#include <QtMath>
 
 /*!
  * \brief An overloaded mutator for the stored image and three residue images.
@@ -51,16 +52,129 @@ void BlurFilter::setSize(int sz) {
 }
 
 /*!
- * \brief Apply the filter to the uploaded image.
+ * \brief An accessor for the size variable, the block size the last apply() blurred and packed the residues with.
+ * \return The size
+ */
+int BlurFilter::getSize() const {
+    return size;
+}
+
+/*!
+ * \brief A mutator for the regions to blur.
+ *
+ * Every block of the grid touching a region is blurred, so the blurred area is the regions grown to whole blocks.
+ *
+ * \param rects The regions in pixels of the image, or an empty vector to blur the whole image
+ */
+void BlurFilter::setRegions(const QVector<QRect> &rects) {
+    regions = rects;
+}
+
+/*!
+ * \brief An accessor for the blocks blurred by the last apply().
+ *
+ * Block k has its residues at column k % n and row k / n of the residue images, counted in blocks, \
+ * where n is the smallest number whose square is at least the number of blocks.
+ *
+ * \return The top-left corners of the blocks, empty if the whole image was blurred
+ */
+QVector<QPoint> BlurFilter::getTiles() {
+    return tiles;
+}
+
+/*!
+ * \brief Put one pixel of the three matrices of doubles into the blurred image and the three residue images.
+ * \param r The red matrix
+ * \param g The green matrix
+ * \param b The blue matrix
+ * \param i The row of the pixel in the image
+ * \param j The column of the pixel in the image
+ * \param ri The row of the pixel in the residue images
+ * \param rj The column of the pixel in the residue images
+ */
+void BlurFilter::storePixel(double **r, double **g, double **b, int i, int j, int ri, int rj) {
+    image.setPixel(j, i,
+            qRgb(static_cast<int>(r[i][j]), static_cast<int>(g[i][j]),
+                    static_cast<int>(b[i][j]))); // let the blurred image contain the integer parts of the three matrices of doubles
+    redResidue.setPixel(rj, ri,
+            qRgba(255, static_cast<int>(r[i][j] * 100) % 100,
+                    static_cast<int>(r[i][j] * 10000) % 100,
+                    static_cast<int>(r[i][j] * 1000000) % 100)); // the red residue image contains digits 1-6 after the decimal point of the red matrix
+    greenResidue.setPixel(rj, ri,
+            qRgba(static_cast<int>(g[i][j] * 100) % 100, 255,
+                    static_cast<int>(g[i][j] * 10000) % 100,
+                    static_cast<int>(g[i][j] * 1000000) % 100)); // the green residue image contains digits 1-6 after the decimal point of the green matrix
+    blueResidue.setPixel(rj, ri,
+            qRgba(static_cast<int>(b[i][j] * 100) % 100,
+                    static_cast<int>(b[i][j] * 10000) % 100, 255,
+                    static_cast<int>(b[i][j] * 1000000) % 100)); // the blue residue image contains digits 1-6 after the decimal point of the blue matrix
+}
+
+/*!
+ * \brief Mark the blocks touching the regions, and list them as the tiles if there are regions.
+ * \return One bit per block, row by row, set for the blocks to blur
+ */
+QBitArray BlurFilter::selectBlocks() {
+    int blockColumns = (image.width() + size - 1) / size;
+    int blockRows = (image.height() + size - 1) / size;
+    QBitArray selected(blockRows * blockColumns, regions.isEmpty());
+    for (const QRect &region : regions) {
+        QRect area = region.intersected(image.rect());
+        if (area.isEmpty()) {
+            continue;
+        }
+        for (int row = area.top() / size; row <= area.bottom() / size; row++) {
+            for (int column = area.left() / size; column <= area.right() / size; column++) {
+                selected.setBit(row * blockColumns + column);
+            }
+        }
+    }
+    tiles.clear();
+    if (!regions.isEmpty()) {
+        for (int block = 0; block < selected.size(); block++) {
+            if (selected.testBit(block)) {
+                tiles.append(QPoint(block % blockColumns * size, block / blockColumns * size));
+            }
+        }
+    }
+    return selected;
+}
+
+/*!
+ * \brief Apply the filter to the uploaded image, or only to the blocks touching the regions if there are any.
+ *
+ * If the same image was blurred with the same size and regions before, the cached result is used instead.
  */
 void BlurFilter::apply() {
     if (image.isNull()) {
         return;
     }
 
+    // Look for an earlier run on the same image and parameters
+    quint64 key = imagehash::image(image, imagehash::bytes("blur", 4));
+    key = imagehash::combine(key, static_cast<quint64>(size));
+    for (const QRect &region : regions) {
+        key = imagehash::combine(key, static_cast<quint64>(region.x()) << 32 | static_cast<quint32>(region.y()));
+        key = imagehash::combine(key, static_cast<quint64>(region.width()) << 32 | static_cast<quint32>(region.height()));
+    }
+    QBitArray selected = selectBlocks();
+    QVector<QImage> cached;
+    if (resultCache().find(key, cached) && cached.size() == 4) {
+        image = cached[0];
+        redResidue = cached[1];
+        greenResidue = cached[2];
+        blueResidue = cached[3];
+        emit(progressUpdated(image.height())); // tell MainWindow that blurring has finished
+        return;
+    }
+
     // Initialize dynamic arrays
+    FilterTrace::Span span("blur", "unpack");
     int h = image.height();
     int w = image.width();
+    span.setPixels(static_cast<qint64>(h) * w);
+    FilterTrace::add(FilterTrace::Allocations, 3 * (h + 1));
+    FilterTrace::add(FilterTrace::Bytes, static_cast<qint64>(image.bytesPerLine()) * h);
     double **r = new double*[h];
     double **g = new double*[h];
     double **b = new double*[h];
@@ -81,9 +195,14 @@ void BlurFilter::apply() {
     }
 
     // Execute blurring for red, green, and blue matrices
+    span.next("transform");
+    int blockColumns = (w + size - 1) / size;
     for (int x = 0; x < h; x += size) {
         emit(progressUpdated(x)); // communicate blurring progress with MainWindow
         for (int y = 0; y < w; y += size) {
+            if (!selected.testBit(x / size * blockColumns + y / size)) {
+                continue;
+            }
             if (cancelled) { // if user has pressed "Cancel", terminate immediately
                 for (int i = 0; i < h; i++) {
                     delete[] r[i];
@@ -124,23 +243,31 @@ void BlurFilter::apply() {
     }
 
     // Put information in the double matrices into four images which can only store integer pixels
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            image.setPixel(j, i,
-                    qRgb(static_cast<int>(r[i][j]), static_cast<int>(g[i][j]),
-                            static_cast<int>(b[i][j]))); // let the blurred image contain the integer parts of the three matrices of doubles
-            redResidue.setPixel(j, i,
-                    qRgba(255, static_cast<int>(r[i][j] * 100) % 100,
-                            static_cast<int>(r[i][j] * 10000) % 100,
-                            static_cast<int>(r[i][j] * 1000000) % 100)); // the red residue image contains digits 1-6 after the decimal point of the red matrix
-            greenResidue.setPixel(j, i,
-                    qRgba(static_cast<int>(g[i][j] * 100) % 100, 255,
-                            static_cast<int>(g[i][j] * 10000) % 100,
-                            static_cast<int>(g[i][j] * 1000000) % 100)); // the green residue image contains digits 1-6 after the decimal point of the green matrix
-            blueResidue.setPixel(j, i,
-                    qRgba(static_cast<int>(b[i][j] * 100) % 100,
-                            static_cast<int>(b[i][j] * 10000) % 100, 255,
-                            static_cast<int>(b[i][j] * 1000000) % 100)); // the blue residue image contains digits 1-6 after the decimal point of the blue matrix
+    span.next("pack");
+    if (regions.isEmpty()) {
+        for (int i = 0; i < h; i++) {
+            for (int j = 0; j < w; j++) {
+                storePixel(r, g, b, i, j, i, j);
+            }
+        }
+    } else {
+        // Only the blurred blocks have residues, packed into a square of blocks
+        int packColumns = qMax(1, qCeil(qSqrt(tiles.size())));
+        int packRows = qMax(1, (tiles.size() + packColumns - 1) / packColumns);
+        redResidue = QImage(packColumns * size, packRows * size, QImage::Format_ARGB32);
+        redResidue.fill(Qt::transparent);
+        greenResidue = redResidue.copy();
+        blueResidue = redResidue.copy();
+        for (int k = 0; k < tiles.size(); k++) {
+            int x = tiles[k].y();
+            int y = tiles[k].x();
+            int cellRow = k / packColumns * size;
+            int cellColumn = k % packColumns * size;
+            for (int i = x; i < qMin(h, x + size); i++) {
+                for (int j = y; j < qMin(w, y + size); j++) {
+                    storePixel(r, g, b, i, j, cellRow + i - x, cellColumn + j - y);
+                }
+            }
         }
     }
 
@@ -153,5 +280,8 @@ void BlurFilter::apply() {
     delete[] r;
     delete[] g;
     delete[] b;
+    FilterTrace::add(FilterTrace::Bytes, static_cast<qint64>(image.bytesPerLine()) * h
+            + static_cast<qint64>(redResidue.bytesPerLine()) * redResidue.height() * 3);
+    resultCache().insert(key, QVector<QImage>{image, redResidue, greenResidue, blueResidue});
     emit(progressUpdated(h)); // tell MainWindow that blurring has finished
 }
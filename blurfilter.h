@@ -1,11 +1,19 @@
 #ifndef BLURFILTER_H
 #define BLURFILTER_H
 
+#include <QVector>
+#include <QRect>
+#include <QPoint>
+#include <QBitArray>
 #include "basefilter.h"
 #include "matrix.h"
 
 /*!
  * \brief The filter for image blurring.
+ *
+ * Either the whole image is blurred and the residue images are as large as the image, or only the blocks \
+ * touching some regions are blurred and the residues of those blocks are packed next to each other, \
+ * in the order given by getTiles().
  */
 class BlurFilter: public BaseFilter {
 public:
@@ -14,12 +22,19 @@ public:
     QImage getGreenResidue();
     QImage getBlueResidue();
     void setSize(int);
+    int getSize() const;
+    void setRegions(const QVector<QRect>&);
+    QVector<QPoint> getTiles();
     virtual void apply() override;
 private:
+    void storePixel(double**, double**, double**, int, int, int, int);
+    QBitArray selectBlocks();
     QImage redResidue; /*!< The red residue image */
     QImage greenResidue; /*!< The green residue image */
     QImage blueResidue; /*!< The blue residue image */
     int size = 10; /*!< The strength of the filter set by the user */
+    QVector<QRect> regions; /*!< The regions to blur, empty to blur the whole image */
+    QVector<QPoint> tiles; /*!< The top-left corners of the blocks blurred by the last apply() if it was limited to regions */
 };
 
 #endif // BLURFILTER_H
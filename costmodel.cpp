@@ -0,0 +1,254 @@
+#include "costmodel.h"
+#include "math.h"
+#include "matrix.h"
+#include <QElapsedTimer>
+#include <QImage>
+#include <QMutex>
+#include <QSettings>
+#include <cmath>
+
+const qint64 CostModel::TIME_WARNING = 60 * 1000;
+
+const qint64 CostModel::MEMORY_WARNING = Q_INT64_C(2) * 1024 * 1024 * 1024;
+
+const int CostModel::VERSION = 1;
+
+double CostModel::deblurUnit = 0;
+
+double CostModel::blurUnit = 0;
+
+double CostModel::pixelUnit = 0;
+
+namespace {
+
+QMutex unitsMutex; // guards the units, which filters on worker threads may ask for at once
+
+/*!
+ * \brief Run a piece of work until it has taken long enough to be timed.
+ * \param work The work
+ * \param minimum The least time to run it for, in milliseconds
+ * \return The nanoseconds one run took, on average
+ */
+template<typename Work>
+double timeRuns(Work work, qint64 minimum) {
+    QElapsedTimer timer;
+    timer.start();
+    int runs = 0;
+    do {
+        work();
+        runs++;
+    } while (timer.elapsed() < minimum);
+    return static_cast<double>(timer.nsecsElapsed()) / runs;
+}
+
+}
+
+/*!
+ * \brief Measure the units on this host and keep them in the settings.
+ *
+ * Takes about a tenth of a second: one 10*10 block is deblurred and blurred over and over, \
+ * and the pixels of a 256*256 image are unpacked, decoded and packed again.
+ */
+void CostModel::calibrate() {
+    const int size = 10;
+    double **block = new double*[size];
+    for (int i = 0; i < size; i++) {
+        block[i] = new double[size];
+    }
+    auto fill = [block, size]() {
+        for (int i = 0; i < size; i++) {
+            for (int j = 0; j < size; j++) {
+                block[i][j] = (i * 7 + j * 13) % 256; // any values do, the work does not depend on them
+            }
+        }
+    };
+    double n = size * size;
+    double deblur = timeRuns([&]() {
+        fill();
+        matrix::deblurMatrix(block, size, size, 0, 0, size);
+    }, 40) / (n * n * n);
+    double blur = timeRuns([&]() {
+        fill();
+        matrix::blurMatrix(block, size, size, 0, 0, size);
+    }, 20) / (n * n);
+    for (int i = 0; i < size; i++) {
+        delete[] block[i];
+    }
+    delete[] block;
+
+    QImage image(256, 256, QImage::Format_RGB32);
+    image.fill(qRgb(200, 100, 50));
+    double pixel = timeRuns([&]() {
+        for (int i = 0; i < image.height(); i++) {
+            for (int j = 0; j < image.width(); j++) {
+                QRgb pix = image.pixel(j, i);
+                image.setPixel(j, i, qRgb(math::extract(qRed(pix)), math::extract(qGreen(pix)), math::extract(qBlue(pix))));
+            }
+        }
+    }, 20) / (image.width() * image.height());
+
+    QMutexLocker locker(&unitsMutex);
+    deblurUnit = deblur;
+    blurUnit = blur;
+    pixelUnit = pixel;
+    QSettings settings;
+    settings.beginGroup("costmodel");
+    settings.setValue("version", VERSION);
+    settings.setValue("deblur", deblurUnit);
+    settings.setValue("blur", blurUnit);
+    settings.setValue("pixel", pixelUnit);
+}
+
+/*!
+ * \brief Read the units from the settings, or measure them if this host has not been measured yet.
+ */
+void CostModel::load() {
+    {
+        QMutexLocker locker(&unitsMutex);
+        if (deblurUnit > 0) {
+            return;
+        }
+        QSettings settings;
+        settings.beginGroup("costmodel");
+        if (settings.value("version").toInt() == VERSION) {
+            deblurUnit = settings.value("deblur").toDouble();
+            blurUnit = settings.value("blur").toDouble();
+            pixelUnit = settings.value("pixel").toDouble();
+            if (deblurUnit > 0 && blurUnit > 0 && pixelUnit > 0) {
+                return;
+            }
+        }
+    }
+    calibrate();
+}
+
+/*!
+ * \brief Add up the work of every block of an image, edge blocks included.
+ * \param size The size of the image
+ * \param strength The block size
+ * \param power The power of the number of pixels in a block that the work of the block grows with
+ * \return The sum over the blocks of their pixels to the power
+ */
+double CostModel::blockUnits(const QSize &size, int strength, int power) {
+    // Blocks are full, except for the last row and the last column, which may be narrower
+    int rows[2] = {size.height() / strength, size.height() % strength > 0 ? 1 : 0};
+    int columns[2] = {size.width() / strength, size.width() % strength > 0 ? 1 : 0};
+    int heights[2] = {strength, size.height() % strength};
+    int widths[2] = {strength, size.width() % strength};
+    double units = 0;
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < 2; j++) {
+            units += static_cast<double>(rows[i]) * columns[j] * std::pow(static_cast<double>(heights[i]) * widths[j], power);
+        }
+    }
+    return units;
+}
+
+/*!
+ * \brief Predict the time and the peak memory of one filter run.
+ *
+ * Memory counts the 32-bit images the filter holds and the planes it copies them into: three planes of doubles \
+ * for blurring and deblurring, plus the one system of equations being solved, and three of ints for encoding \
+ * and decoding.
+ *
+ * \param operation The filter
+ * \param size The size of the image, or of the secret when encoding
+ * \param strength The block size for blurring and deblurring, 0 if it is detected, which is predicted as the highest
+ * \param blocks The number of whole blocks blurred or deblurred when only some are, e.g. the tiles of packed \
+ * residues, or 0 for every block of the image
+ * \return The prediction
+ */
+CostModel::Estimate CostModel::estimate(Operation operation, const QSize &size, int strength, int blocks) {
+    load();
+    QMutexLocker locker(&unitsMutex);
+    Estimate estimate;
+    if (size.isEmpty()) {
+        return estimate;
+    }
+    qint64 pixels = static_cast<qint64>(size.width()) * size.height();
+    int s = strength > 0 ? strength : 20;
+    double blockPixels = static_cast<double>(s) * s;
+    double blurBlocks = blocks > 0 ? blocks * blockPixels * blockPixels : blockUnits(size, s, 2);
+    double deblurBlocks = blocks > 0 ? blocks * blockPixels * blockPixels * blockPixels : blockUnits(size, s, 3);
+    double nanoseconds = 0;
+    switch (operation) {
+    case Blur:
+        nanoseconds = 3 * blurUnit * blurBlocks + pixelUnit * pixels;
+        estimate.bytes = pixels * (4 * 4 + 3 * 8) + Q_INT64_C(8) * s * s * (s * s + 1);
+        break;
+    case Deblur:
+        nanoseconds = 3 * deblurUnit * deblurBlocks + pixelUnit * pixels;
+        estimate.bytes = pixels * (5 * 4 + 3 * 8) + Q_INT64_C(8) * s * s * (s * s + 1);
+        break;
+    case Encode:
+        nanoseconds = 2 * pixelUnit * pixels; // the base image is scaled and degraded first
+        estimate.bytes = pixels * (3 * 4 + 2 * 3 * 4);
+        break;
+    case Decode:
+        nanoseconds = pixelUnit * pixels;
+        estimate.bytes = pixels * (2 * 4 + 3 * 4);
+        break;
+    }
+    estimate.milliseconds = static_cast<qint64>(nanoseconds / 1e6);
+    return estimate;
+}
+
+/*!
+ * \brief Check if a run is worth warning about before it starts.
+ * \param estimate The prediction of the run
+ * \return Whether it goes over TIME_WARNING or MEMORY_WARNING
+ */
+bool CostModel::isLong(const Estimate &estimate) {
+    return estimate.milliseconds >= TIME_WARNING || estimate.bytes >= MEMORY_WARNING;
+}
+
+/*!
+ * \brief Predict how long a running job still needs.
+ *
+ * At first the prediction made before the job started is trusted. As the job goes on, the pace it has \
+ * kept so far takes over, fully from a tenth of the job on.
+ *
+ * \param predicted The time predicted before the job started, in milliseconds
+ * \param elapsed The time since the job started, in milliseconds
+ * \param progress The share of the job done, between 0 and 1
+ * \return The time left, in milliseconds
+ */
+qint64 CostModel::remaining(qint64 predicted, qint64 elapsed, double progress) {
+    double planned = qMax<qint64>(predicted - elapsed, 0);
+    if (progress <= 0) {
+        return static_cast<qint64>(planned);
+    }
+    double measured = elapsed * (1 - progress) / progress;
+    double weight = qMin(progress * 10, 1.0);
+    return static_cast<qint64>(weight * measured + (1 - weight) * planned);
+}
+
+/*!
+ * \brief Describe a time for people, rounded to what matters.
+ * \param milliseconds The time
+ * \return e.g. "about 3 min"
+ */
+QString CostModel::describeTime(qint64 milliseconds) {
+    if (milliseconds < 1000) {
+        return "under a second";
+    }
+    if (milliseconds < 60 * 1000) {
+        return QString("about %1 s").arg((milliseconds + 500) / 1000);
+    }
+    if (milliseconds < 60 * 60 * 1000) {
+        return QString("about %1 min").arg((milliseconds + 30 * 1000) / (60 * 1000));
+    }
+    return QString("about %1 h").arg(milliseconds / (60 * 60 * 1000.0), 0, 'f', 1);
+}
+
+/*!
+ * \brief Describe an amount of memory for people.
+ * \param bytes The amount
+ * \return e.g. "1.5 GB"
+ */
+QString CostModel::describeMemory(qint64 bytes) {
+    if (bytes < 1024 * 1024 * 1024) {
+        return QString("%1 MB").arg((bytes + 1024 * 1024 - 1) / (1024 * 1024));
+    }
+    return QString("%1 GB").arg(bytes / (1024.0 * 1024 * 1024), 0, 'f', 1);
+}
@@ -0,0 +1,54 @@
+#ifndef COSTMODEL_H
+#define COSTMODEL_H
+
+#include <QSize>
+#include <QString>
+#include <QtGlobal>
+
+/*!
+ * \brief Predicts how long a filter takes and how much memory it needs, before it runs.
+ *
+ * Deblurring solves one system of s*s equations per block and channel, so it grows with the number of blocks \
+ * times s^6; blurring averages every pixel of a block over the block, s^4. The time of one unit of each is \
+ * measured by a short microbenchmark the first time a prediction is asked for, and kept in the settings \
+ * (group "costmodel") so later runs on the same host start with it.
+ */
+class CostModel {
+public:
+    CostModel() = delete;
+
+    /*!
+     * \brief The filters that can be predicted.
+     */
+    enum Operation {
+        Blur, /*!< BlurFilter */
+        Deblur, /*!< DeblurFilter */
+        Encode, /*!< EncodeFilter, with the size of the secret */
+        Decode /*!< DecodeFilter */
+    };
+
+    /*!
+     * \brief A prediction of one filter run.
+     */
+    struct Estimate {
+        qint64 milliseconds = 0; /*!< The wall time, on one thread */
+        qint64 bytes = 0; /*!< The peak memory of the filter, including its inputs and outputs */
+    };
+    static Estimate estimate(Operation, const QSize&, int, int = 0);
+    static bool isLong(const Estimate&);
+    static qint64 remaining(qint64, qint64, double);
+    static QString describeTime(qint64);
+    static QString describeMemory(qint64);
+    static void calibrate();
+    static const qint64 TIME_WARNING; /*!< The least predicted time in milliseconds that is worth a warning */
+    static const qint64 MEMORY_WARNING; /*!< The least predicted memory in bytes that is worth a warning */
+private:
+    static void load();
+    static double blockUnits(const QSize&, int, int);
+    static const int VERSION; /*!< Changes whenever the microbenchmark does, so older measurements are redone */
+    static double deblurUnit; /*!< Nanoseconds per (block pixels)^3 of one channel, 0 until measured */
+    static double blurUnit; /*!< Nanoseconds per (block pixels)^2 of one channel */
+    static double pixelUnit; /*!< Nanoseconds to unpack, transform and pack one pixel */
+};
+
+#endif // COSTMODEL_H
@@ -1,13 +1,43 @@
 #include "deblurfilter.h"
+#include "imagehash.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QtMath>
+#include <QtConcurrent>
+#include <cmath>
+
+const int DeblurFilter::PUBLISH_INTERVAL = 66;
+
+const int DeblurFilter::SAMPLE_COUNT = 6;
+
+const int DeblurFilter::CHECKPOINT_INTERVAL = 2000;
+
+const int DeblurFilter::VALIDATE_BLOCKS = 4;
+
+const double DeblurFilter::MAX_OUT_OF_RANGE = 0.05;
+
+const double DeblurFilter::MAX_REBLUR = 0.1;
+
+/*!
+ * \brief destructor: deallocate the restored matrices.
+ */
+DeblurFilter::~DeblurFilter() {
+    release();
+}
 
 /*!
  * \brief An overloaded mutator for the image-to-be-deblurred and the three residue images.
+ *
+ * Any deblurring done for the previous images is discarded.
+ *
  * \param img The image to be deblurred
  * \param red The red residue image
  * \param green The green residue image
  * \param blue The blue residue image
  */
 void DeblurFilter::setImage(QImage img, QImage red, QImage green, QImage blue) {
+    release();
+    source = img;
     image = img;
     redResidue = red;
     greenResidue = green;
@@ -17,42 +47,376 @@ void DeblurFilter::setImage(QImage img, QImage red, QImage green, QImage blue) {
 /*!
  * \brief An mutator for the size variable.
  *
- * This effectively changes the blurring strength of the filter.
+ * This effectively changes the blurring strength of the filter. Any deblurring done with the previous size is discarded.
  *
  * \param sz The new size selected by the image
  */
 void DeblurFilter::setSize(int sz) {
+    if (sz != size) {
+        release();
+    }
     size = sz;
 }
 
 /*!
- * \brief Apply the filter to uploaded images.
+ * \brief An accessor for the size variable.
+ * \return The strength the filter deblurs with
  */
-void DeblurFilter::apply() {
-    cancelled = false;
-    if (image.isNull()) {
+int DeblurFilter::getSize() const {
+    return size;
+}
+
+/*!
+ * \brief A mutator for the blocks covered by packed residue images, as written by BlurFilter when it blurred only some regions.
+ *
+ * Any deblurring done for the previous blocks is discarded.
+ *
+ * \param blocks The top-left corners of the blurred blocks, or an empty vector if the residues cover the whole image
+ */
+void DeblurFilter::setTiles(const QVector<QPoint> &blocks) {
+    release();
+    tiles = blocks;
+}
+
+/*!
+ * \brief Find the size the image was blurred with by deblurring a few sample blocks with every candidate.
+ *
+ * The samples start at multiples of every candidate, so each one is a whole block whatever the size. \
+ * All samples of all candidates are deblurred in parallel. With the right size, the deblurred values are \
+ * whole numbers from 0 to 255 and blurring them again gives back the blurred values; the candidate that \
+ * comes closest to this wins. Only works when the residues cover the whole image.
+ *
+ * \param candidates The sizes to try
+ * \return The most likely size, or 0 if there are no candidates or no image
+ */
+int DeblurFilter::detectSize(const QVector<int> &candidates) {
+    if (image.isNull() || candidates.isEmpty()) {
+        return 0;
+    }
+    if (redResidue.size() != image.size() || greenResidue.size() != image.size() || blueResidue.size() != image.size()) {
+        return candidates.first(); // nothing to sample, apply() reports the residues
+    }
+    FilterTrace::Span span("deblur", "detect size");
+
+    // Samples start on a grid that every candidate's blocks line up with
+    int h = image.height();
+    int w = image.width();
+    int step = 1;
+    int largest = 0;
+    for (int candidate : candidates) {
+        int a = step, b = candidate;
+        while (b != 0) {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        step = step / a * candidate;
+        largest = qMax(largest, candidate);
+    }
+    QVector<QPoint> corners;
+    for (int x = 0; x + largest <= h; x += step) {
+        for (int y = 0; y + largest <= w; y += step) {
+            corners.append(QPoint(y, x));
+        }
+    }
+    if (corners.isEmpty()) {
+        corners.append(QPoint(0, 0));
+    }
+    QVector<QPoint> samples;
+    for (int k = 0; k < qMin(SAMPLE_COUNT, corners.size()); k++) {
+        samples.append(corners[k * corners.size() / qMin(SAMPLE_COUNT, corners.size())]); // spread over the image
+    }
+
+    // Restore the sample blocks for every candidate
+    QVector<SizeTrial> trials;
+    for (int candidate : candidates) {
+        for (const QPoint &sample : samples) {
+            SizeTrial trial;
+            trial.size = candidate;
+            trial.rows = qMin(candidate, h - sample.y());
+            trial.columns = qMin(candidate, w - sample.x());
+            trial.score = 0;
+            for (int i = sample.y(); i < sample.y() + trial.rows; i++) {
+                for (int j = sample.x(); j < sample.x() + trial.columns; j++) {
+                    QRgb pix = image.pixel(j, i);
+                    QRgb pixR = redResidue.pixel(j, i);
+                    QRgb pixG = greenResidue.pixel(j, i);
+                    QRgb pixB = blueResidue.pixel(j, i);
+                    trial.red.append(qRed(pix) + qGreen(pixR) / 100.0 + qBlue(pixR) / 10000.0 + qAlpha(pixR) / 1000000.0);
+                    trial.green.append(qGreen(pix) + qRed(pixG) / 100.0 + qBlue(pixG) / 10000.0 + qAlpha(pixG) / 1000000.0);
+                    trial.blue.append(qBlue(pix) + qRed(pixB) / 100.0 + qGreen(pixB) / 10000.0 + qAlpha(pixB) / 1000000.0);
+                }
+            }
+            trials.append(trial);
+        }
+    }
+    QtConcurrent::blockingMap(trials, &DeblurFilter::scoreTrial);
+
+    // Pick the candidate whose samples look most like a valid image
+    int best = candidates.first();
+    double bestScore = -1;
+    for (int candidate : candidates) {
+        double score = 0;
+        for (const SizeTrial &trial : trials) {
+            if (trial.size == candidate) {
+                score += trial.score;
+            }
+        }
+        if (bestScore < 0 || score < bestScore) {
+            best = candidate;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+/*!
+ * \brief Score one sample block deblurred with one candidate size.
+ *
+ * This only touches the trial, so it can run on a worker thread.
+ *
+ * \param trial The sample and the candidate size, its score is filled in
+ */
+void DeblurFilter::scoreTrial(SizeTrial &trial) {
+    trial.score = scoreChannel(trial.red, trial.rows, trial.columns, trial.size)
+            + scoreChannel(trial.green, trial.rows, trial.columns, trial.size)
+            + scoreChannel(trial.blue, trial.rows, trial.columns, trial.size);
+}
+
+/*!
+ * \brief Deblur one color of a block and measure how far it is from a valid image.
+ *
+ * The score adds up how far every deblurred value is from a whole number, one for every value outside [0, 255], \
+ * and how far blurring the rounded values again is from the blurred values, averaged over the block.
+ *
+ * \param values The restored values of the block, row by row
+ * \param rows The number of rows of the block
+ * \param columns The number of columns of the block
+ * \param size The candidate size
+ * \return The score, lower is better
+ */
+double DeblurFilter::scoreChannel(const QVector<double> &values, int rows, int columns, int size) {
+    double **block = new double*[rows];
+    for (int i = 0; i < rows; i++) {
+        block[i] = new double[columns];
+        for (int j = 0; j < columns; j++) {
+            block[i][j] = values[i * columns + j];
+        }
+    }
+
+    BlockCheck result;
+    matrix::deblurMatrix(block, rows, columns, 0, 0, size);
+    checkChannel(block, rows, columns, 0, 0, size, values, result);
+    for (int i = 0; i < rows; i++) {
+        delete[] block[i];
+    }
+    delete[] block;
+    return (result.integrality + result.outOfRange + result.reblur) / result.values;
+}
+
+/*!
+ * \brief Measure how far one deblurred block of a matrix is from a valid image, and add it to a BlockCheck.
+ *
+ * A valid block has whole numbers from 0 to 255, and blurring it again gives back the blurred values. \
+ * The matrix is not changed.
+ *
+ * \param input The deblurred matrix
+ * \param h The number of rows
+ * \param w The number of columns
+ * \param x The first row of the block
+ * \param y The first column of the block
+ * \param size The size of the block
+ * \param blurred The values of the block before it was deblurred, row by row
+ * \param result The BlockCheck to add to
+ */
+void DeblurFilter::checkChannel(double **input, int h, int w, int x, int y, int size,
+        const QVector<double> &blurred, BlockCheck &result) {
+    int rows = qMin(size, h - x);
+    int columns = qMin(size, w - y);
+    double **block = new double*[rows];
+    for (int i = 0; i < rows; i++) {
+        block[i] = new double[columns];
+        for (int j = 0; j < columns; j++) {
+            double value = input[x + i][y + j];
+            double rounded = std::floor(value + 0.5);
+            result.integrality += qAbs(value - rounded); // a pixel value is a whole number
+            if (rounded < 0 || rounded > 255) {
+                result.outOfRange++; // and fits in a byte
+            }
+            block[i][j] = rounded;
+        }
+    }
+    matrix::blurMatrix(block, rows, columns, 0, 0, size);
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < columns; j++) {
+            result.reblur += qAbs(block[i][j] - blurred[i * columns + j]); // blurring it again gives back what was restored
+        }
+        delete[] block[i];
+    }
+    delete[] block;
+    result.values += rows * columns;
+}
+
+/*!
+ * \brief Copy one block of a matrix.
+ * \param input The matrix
+ * \param h The number of rows
+ * \param w The number of columns
+ * \param x The first row of the block
+ * \param y The first column of the block
+ * \param size The size of the block
+ * \return The values of the block, row by row
+ */
+QVector<double> DeblurFilter::copyBlock(double **input, int h, int w, int x, int y, int size) {
+    QVector<double> values;
+    for (int i = x; i < qMin(h, x + size); i++) {
+        for (int j = y; j < qMin(w, y + size); j++) {
+            values.append(input[i][j]);
+        }
+    }
+    return values;
+}
+
+/*!
+ * \brief Decide from the checked blocks whether the strength and residues match the image.
+ *
+ * Only the values outside [0, 255] and the reblur are limits. The distance from whole numbers is not one: \
+ * the six digits kept by the residues leave large blocks up to about 0.3 away even at the right size, \
+ * above the 0.25 of random values, so it cannot tell garbage apart and is only used to rank sizes in detectSize(). \
+ * Sets the error if the strength or residues do not match.
+ *
+ * \return Whether the checked blocks look like a valid image
+ */
+bool DeblurFilter::validate() {
+    if (check.values == 0) {
+        return true;
+    }
+    double outOfRange = static_cast<double>(check.outOfRange) / check.values;
+    double reblur = check.reblur / check.values;
+    if (outOfRange <= MAX_OUT_OF_RANGE && reblur <= MAX_REBLUR) {
+        return true;
+    }
+    error = QString("The first %1 blocks do not deblur to a valid image, so the strength or the residue images "
+            "do not match the blurred image. %2% of the values are outside 0 to 255 (at most %3%), "
+            "and blurring them again is %4 off on average (at most %5).")
+            .arg(checkedBlocks).arg(outOfRange * 100, 0, 'f', 1).arg(MAX_OUT_OF_RANGE * 100)
+            .arg(reblur, 0, 'f', 3).arg(MAX_REBLUR);
+    return false;
+}
+
+/*!
+ * \brief Check that the residue images hold a value for every blurred pixel.
+ *
+ * Without tiles they must be the size of the image; with tiles they must hold the packed blocks, \
+ * as many columns of blocks as the square root of their number, rounded up. Sets the error if they do not.
+ *
+ * \return Whether the residues can be used
+ */
+bool DeblurFilter::checkResidues() {
+    if (tiles.isEmpty()) {
+        if (redResidue.size() == source.size() && greenResidue.size() == source.size()
+                && blueResidue.size() == source.size()) {
+            return true;
+        }
+        error = QString("The residue images must be the size of the blurred image (%1 x %2) when no blocks are listed.")
+                .arg(source.width()).arg(source.height());
+        return false;
+    }
+    int packColumns = qMax(1, qCeil(qSqrt(tiles.size())));
+    int packRows = (tiles.size() + packColumns - 1) / packColumns;
+    QSize packed(packColumns * size, packRows * size);
+    for (const QImage &residue : {redResidue, greenResidue, blueResidue}) {
+        if (residue.width() < packed.width() || residue.height() < packed.height()) {
+            error = QString("The residue images must be at least %1 x %2 to hold the %3 blocks listed.")
+                    .arg(packed.width()).arg(packed.height()).arg(tiles.size());
+            return false;
+        }
+    }
+    return true;
+}
+
+/*!
+ * \brief Take the whole deblurred image from the result cache, if the same inputs have been deblurred before.
+ *
+ * The cache is only looked up before any block has been deblurred, and the whole image is sent with regionUpdated.
+ *
+ * \param region The region being deblurred, in pixels
+ * \return Whether the image came from the cache, so there is nothing left to deblur
+ */
+bool DeblurFilter::restoreCached(const QRect &region) {
+    if (!cached) {
+        QVector<QImage> result;
+        if (r != nullptr || !resultCache().find(inputKey(), result) || result.size() != 1
+                || result[0].size() != source.size()) {
+            return false;
+        }
+        image = result[0];
+        cached = true;
+        emit(regionUpdated(image.rect(), image));
+    }
+    emit(progressUpdated(region.bottom() + 1)); // tell MainWindow that deblurring has finished
+    return true;
+}
+
+/*!
+ * \brief Restore the red, green, and blue matrices from the four images, unless it has been done already.
+ *
+ * With packed residues, the blocks that were not blurred are whole numbers already and are marked as done. \
+ * The blocks found in the journal of an earlier run on the same inputs are put back into the image and marked as done too.
+ */
+void DeblurFilter::restore() {
+    if (r != nullptr) {
         return;
     }
+    FilterTrace::Span span("deblur", "unpack");
+    image = source; // drop blocks written with an earlier size
+    span.setPixels(static_cast<qint64>(image.height()) * image.width());
 
     // Initialize dynamic arrays
     int h = image.height();
     int w = image.width();
-    double **r = new double*[h];
-    double **g = new double*[h];
-    double **b = new double*[h];
+    rows = h;
+    FilterTrace::add(FilterTrace::Allocations, 3 * (h + 1));
+    FilterTrace::add(FilterTrace::Bytes, static_cast<qint64>(source.bytesPerLine()) * h
+            + static_cast<qint64>(redResidue.bytesPerLine()) * redResidue.height() * 3);
+    r = new double*[h];
+    g = new double*[h];
+    b = new double*[h];
     for (int i = 0; i < h; i++) {
         r[i] = new double[w];
         g[i] = new double[w];
         b[i] = new double[w];
     }
 
+    // Find where the residues of each blurred block are packed
+    int blockRows = (h + size - 1) / size;
+    int blockColumns = (w + size - 1) / size;
+    int packColumns = qMax(1, qCeil(qSqrt(tiles.size())));
+    QHash<int, int> cells; // block index to position in the residue images
+    for (int k = 0; k < tiles.size(); k++) {
+        cells.insert(tiles[k].y() / size * blockColumns + tiles[k].x() / size, k);
+    }
+
     // Restore the red, green, and blue matrices from four images
     for (int i = 0; i < h; i++) {
         for (int j = 0; j < w; j++) {
             QRgb pix = image.pixel(j, i);
-            QRgb pixR = redResidue.pixel(j, i);
-            QRgb pixG = greenResidue.pixel(j, i);
-            QRgb pixB = blueResidue.pixel(j, i);
+            int ri = i;
+            int rj = j;
+            if (!tiles.isEmpty()) {
+                int cell = cells.value(i / size * blockColumns + j / size, -1);
+                if (cell < 0) { // this block was not blurred
+                    r[i][j] = qRed(pix);
+                    g[i][j] = qGreen(pix);
+                    b[i][j] = qBlue(pix);
+                    continue;
+                }
+                ri = cell / packColumns * size + i % size;
+                rj = cell % packColumns * size + j % size;
+            }
+            QRgb pixR = redResidue.pixel(rj, ri);
+            QRgb pixG = greenResidue.pixel(rj, ri);
+            QRgb pixB = blueResidue.pixel(rj, ri);
             r[i][j] = qRed(pix) + qGreen(pixR) / 100.0 + qBlue(pixR) / 10000.0
                     + qAlpha(pixR) / 1000000.0; // restore the double matrix containing averages of red color of the original image from the blurred image and the three residue images
             g[i][j] = qGreen(pix) + qRed(pixG) / 100.0 + qBlue(pixG) / 10000.0
@@ -62,66 +426,296 @@ void DeblurFilter::apply() {
         }
     }
 
+    done = QBitArray(blockRows * blockColumns, !tiles.isEmpty());
+    for (int block : cells.keys()) {
+        done.clearBit(block);
+    }
+
+    // Resume from the journal of an earlier run on the same inputs
+    span.next("resume");
+    QVector<QPair<int, QByteArray>> saved = journal.open(inputKey(), w, h, size);
+    QRect resumed;
+    for (const QPair<int, QByteArray> &record : saved) {
+        int block = record.first;
+        if (block < 0 || block >= done.size()) {
+            continue;
+        }
+        int x = block / blockColumns * size;
+        int y = block % blockColumns * size;
+        int xSize = qMin(size, h - x);
+        int ySize = qMin(size, w - y);
+        const QByteArray &pixels = record.second;
+        if (pixels.size() != xSize * ySize * 3) {
+            continue;
+        }
+        const uchar *p = reinterpret_cast<const uchar*>(pixels.constData());
+        for (int i = x; i < x + xSize; i++) {
+            for (int j = y; j < y + ySize; j++, p += 3) {
+                image.setPixel(j, i, qRgb(p[0], p[1], p[2]));
+            }
+        }
+        done.setBit(block);
+        resumed |= QRect(y, x, ySize, xSize);
+    }
+    if (!resumed.isNull()) {
+        checkedBlocks = VALIDATE_BLOCKS; // these blocks passed the check before they were saved
+        emit(regionUpdated(resumed, image.copy(resumed)));
+    }
+}
+
+/*!
+ * \brief Compute the key of the journal: a hash of everything the deblurred image depends on.
+ * \return The hash of the image, the residues, the size, and the packed blocks
+ */
+quint64 DeblurFilter::inputKey() const {
+    quint64 key = imagehash::image(source);
+    key = imagehash::image(redResidue, key);
+    key = imagehash::image(greenResidue, key);
+    key = imagehash::image(blueResidue, key);
+    key = imagehash::combine(key, static_cast<quint64>(size));
+    for (const QPoint &tile : tiles) {
+        key = imagehash::combine(key, static_cast<quint64>(tile.x()));
+        key = imagehash::combine(key, static_cast<quint64>(tile.y()));
+    }
+    return key;
+}
+
+/*!
+ * \brief Get the red, green, and blue bytes of one block of the image, as saved in the journal.
+ * \param x The first row of the block
+ * \param y The first column of the block
+ * \return Three bytes per pixel, row by row
+ */
+QByteArray DeblurFilter::blockPixels(int x, int y) const {
+    QByteArray pixels;
+    for (int i = x; i < qMin(image.height(), x + size); i++) {
+        for (int j = y; j < qMin(image.width(), y + size); j++) {
+            QRgb pix = image.pixel(j, i);
+            pixels.append(static_cast<char>(qRed(pix)));
+            pixels.append(static_cast<char>(qGreen(pix)));
+            pixels.append(static_cast<char>(qBlue(pix)));
+        }
+    }
+    return pixels;
+}
+
+/*!
+ * \brief Save the blocks finished since the last checkpoint to the journal.
+ */
+void DeblurFilter::checkpoint() {
+    FilterTrace::Span span("deblur", "journal");
+    int blockColumns = (image.width() + size - 1) / size;
+    for (int block : unsaved) {
+        journal.append(block, blockPixels(block / blockColumns * size, block % blockColumns * size));
+    }
+    unsaved.clear();
+    journal.flush();
+}
+
+/*!
+ * \brief Deallocate the restored matrices and forget which blocks have been deblurred.
+ */
+void DeblurFilter::release() {
+    cached = false;
+    if (r == nullptr) {
+        return;
+    }
+    checkpoint();
+    journal.close();
+    for (int i = 0; i < rows; i++) {
+        delete[] r[i];
+        delete[] g[i];
+        delete[] b[i];
+    }
+    delete[] r;
+    delete[] g;
+    delete[] b;
+    r = g = b = nullptr;
+    rows = 0;
+    done.clear();
+    check = BlockCheck();
+    checkedBlocks = 0;
+}
+
+/*!
+ * \brief Write one deblurred block of the red, green, and blue matrices back into the image.
+ *
+ * Values are rounded and clamped to [0, 255], so that a slightly-off solution does not wrap around to the other end.
+ *
+ * \param x The first row of the block
+ * \param y The first column of the block
+ */
+void DeblurFilter::writeBlock(int x, int y) {
+    FilterTrace::Span span("deblur", "pack", true);
+    qint64 pixels = static_cast<qint64>(qMin(size, image.height() - x)) * qMin(size, image.width() - y);
+    span.setPixels(pixels);
+    FilterTrace::add(FilterTrace::Bytes, pixels * 4);
+    for (int i = x; i < qMin(image.height(), x + size); i++) {
+        for (int j = y; j < qMin(image.width(), y + size); j++) {
+            image.setPixel(j, i,
+                    qRgb(qBound(0, qRound(qBound(-1.0, r[i][j], 256.0)), 255),
+                            qBound(0, qRound(qBound(-1.0, g[i][j], 256.0)), 255),
+                            qBound(0, qRound(qBound(-1.0, b[i][j], 256.0)), 255)));
+        }
+    }
+}
+
+/*!
+ * \brief Deblur every block touching a region that has not been deblurred yet.
+ *
+ * The first VALIDATE_BLOCKS blocks are checked before any of them is written: if they do not look like \
+ * a valid image, deblurring stops right away with an error, instead of spending minutes producing garbage. \
+ * After that, every block is written into the image as soon as it is deblurred. The blocks finished since the last \
+ * regionUpdated signal are sent together, at most once every PUBLISH_INTERVAL milliseconds. \
+ * Cancelling stops before the next block, so the blocks already done are kept.
+ *
+ * \param region The region to deblur, in pixels
+ */
+void DeblurFilter::deblurBlocks(const QRect &region) {
+    int h = image.height();
+    int w = image.width();
+    int blockColumns = (w + size - 1) / size;
+    int firstRow = region.top() / size * size;
+    int firstColumn = region.left() / size * size;
+
     // Execute deblurring for red, green, and blue matrices
-    for (int x = 0; x < h; x += size) {
+    QElapsedTimer publishTimer;
+    publishTimer.start();
+    QElapsedTimer checkpointTimer;
+    checkpointTimer.start();
+    QRect dirty; // the blocks finished since the last regionUpdated signal
+    QVector<QPoint> unchecked; // the blocks waiting for validation to be written
+    for (int x = firstRow; x <= region.bottom(); x += size) {
         emit(progressUpdated(x)); // communicate deblurring progress with MainWindow
-        for (int y = 0; y < w; y += size) {
+        for (int y = firstColumn; y <= region.right(); y += size) {
             if (cancelled) { // if user has pressed "Cancel", terminate immediately
-                for (int i = 0; i < h; i++) {
-                    delete[] r[i];
-                    delete[] g[i];
-                    delete[] b[i];
-                }
-                delete[] r;
-                delete[] g;
-                delete[] b;
-                return;
+                break;
             }
-            matrix::deblurMatrix(r, h, w, x, y, size); // manipulate the red matrix with the method documented in matrix.cpp
-            if (cancelled) {
-                for (int i = 0; i < h; i++) {
-                    delete[] r[i];
-                    delete[] g[i];
-                    delete[] b[i];
-                }
-                delete[] r;
-                delete[] g;
-                delete[] b;
-                return;
+            int block = x / size * blockColumns + y / size;
+            if (done.testBit(block)) {
+                continue;
+            }
+            bool checking = checkedBlocks < VALIDATE_BLOCKS;
+            QVector<double> blurredR, blurredG, blurredB;
+            if (checking) {
+                blurredR = copyBlock(r, h, w, x, y, size);
+                blurredG = copyBlock(g, h, w, x, y, size);
+                blurredB = copyBlock(b, h, w, x, y, size);
             }
+            matrix::deblurMatrix(r, h, w, x, y, size); // manipulate the red matrix with the method documented in matrix.cpp
             matrix::deblurMatrix(g, h, w, x, y, size); // manipulate the green matrix with the method documented in matrix.cpp
-            if (cancelled) {
-                for (int i = 0; i < h; i++) {
-                    delete[] r[i];
-                    delete[] g[i];
-                    delete[] b[i];
+            matrix::deblurMatrix(b, h, w, x, y, size); // manipulate the blue matrix with the method documented in matrix.cpp
+            done.setBit(block);
+
+            if (checking) {
+                // Hold the block back until enough blocks have been checked
+                FilterTrace::Span span("deblur", "validate", true);
+                checkChannel(r, h, w, x, y, size, blurredR, check);
+                checkChannel(g, h, w, x, y, size, blurredG, check);
+                checkChannel(b, h, w, x, y, size, blurredB, check);
+                checkedBlocks++;
+                unchecked.append(QPoint(y, x));
+                if (checkedBlocks < VALIDATE_BLOCKS) {
+                    continue;
+                }
+                if (!validate()) {
+                    journal.remove();
+                    release(); // nothing has been written, start over with the next images or size
+                    return;
+                }
+                for (const QPoint &corner : unchecked) {
+                    writeBlock(corner.y(), corner.x());
+                    unsaved.append(corner.y() / size * blockColumns + corner.x() / size);
+                    dirty |= QRect(corner.x(), corner.y(), qMin(size, w - corner.x()), qMin(size, h - corner.y()));
                 }
-                delete[] r;
-                delete[] g;
-                delete[] b;
-                return;
+                unchecked.clear();
+            } else {
+                // Construct this block of the original image
+                writeBlock(x, y);
+                unsaved.append(block);
+                dirty |= QRect(y, x, qMin(size, w - y), qMin(size, h - x));
+            }
+
+            // Publish the finished blocks if enough time has passed
+            if (publishTimer.elapsed() >= PUBLISH_INTERVAL) {
+                emit(regionUpdated(dirty, image.copy(dirty)));
+                dirty = QRect();
+                publishTimer.restart();
+            }
+            if (checkpointTimer.elapsed() >= CHECKPOINT_INTERVAL) {
+                checkpoint();
+                checkpointTimer.restart();
             }
-            matrix::deblurMatrix(b, h, w, x, y, size); // manipulate the blue matrix with the method documented in matrix.cpp
+        }
+        if (cancelled) {
+            break;
         }
     }
 
-    // Construct the original image
-    for (int i = 0; i < h; i++) {
-        for (int j = 0; j < w; j++) {
-            image.setPixel(j, i,
-                    qRgb(static_cast<int>(r[i][j]), static_cast<int>(g[i][j]),
-                            static_cast<int>(b[i][j])));
+    // The region had fewer blocks than are checked, so decide from what there is
+    if (!unchecked.isEmpty()) {
+        if (!validate()) {
+            journal.remove();
+            release();
+            return;
+        }
+        for (const QPoint &corner : unchecked) {
+            writeBlock(corner.y(), corner.x());
+            unsaved.append(corner.y() / size * blockColumns + corner.x() / size);
+            dirty |= QRect(corner.x(), corner.y(), qMin(size, w - corner.x()), qMin(size, h - corner.y()));
         }
     }
+    if (!dirty.isNull()) {
+        emit(regionUpdated(dirty, image.copy(dirty)));
+    }
 
-    // Deallocate dynamic arrays
-    for (int i = 0; i < h; i++) {
-        delete[] r[i];
-        delete[] g[i];
-        delete[] b[i];
+    // Keep what has been done in case the job is stopped, and forget it once the whole image is done
+    checkpoint();
+    if (isComplete()) {
+        journal.remove();
+        resultCache().insert(inputKey(), QVector<QImage>{image});
     }
-    delete[] r;
-    delete[] g;
-    delete[] b;
-    emit(progressUpdated(h)); // tell MainWindow that deblurring has finished
+    emit(progressUpdated(region.bottom() + 1)); // tell MainWindow that deblurring has finished
+}
+
+/*!
+ * \brief Apply the filter to every block of the uploaded images that has not been deblurred yet.
+ */
+void DeblurFilter::apply() {
+    cancelled = false;
+    error.clear();
+    if (image.isNull() || !checkResidues() || restoreCached(image.rect())) {
+        return;
+    }
+    restore();
+    deblurBlocks(image.rect());
+}
+
+/*!
+ * \brief Apply the filter only to the blocks touching a region, e.g. the part of the image being looked at.
+ *
+ * Progress is reported from the first to one past the last row of the region.
+ *
+ * \param region The region to deblur, in pixels
+ */
+void DeblurFilter::applyRegion(const QRect &region) {
+    cancelled = false;
+    error.clear();
+    if (image.isNull()) {
+        return;
+    }
+    QRect area = region.intersected(image.rect());
+    if (area.isEmpty() || !checkResidues() || restoreCached(area)) {
+        return;
+    }
+    restore();
+    deblurBlocks(area);
+}
+
+/*!
+ * \brief Check if every block has been deblurred.
+ * \return Whether the image is fully deblurred
+ */
+bool DeblurFilter::isComplete() const {
+    return cached || (r != nullptr && done.count(true) == done.size());
 }
@@ -1,23 +1,96 @@
 #ifndef DEBLURFILTER_H
 #define DEBLURFILTER_H
 
+#include <QBitArray>
+#include <QRect>
+#include <QPoint>
+#include <QVector>
 #include "basefilter.h"
 #include "matrix.h"
+#include "deblurjournal.h"
 
 /*!
  * \brief The filter for image deblurring
+ *
+ * The blocks of the image are deblurred independently, so a region can be deblurred on its own. \
+ * The restored matrices and the blocks already done are kept until the images or the size change, \
+ * so the rest of the image can be deblurred later without repeating any block. Finished blocks are also \
+ * written to a DeblurJournal every CHECKPOINT_INTERVAL milliseconds, so a later run on the same inputs \
+ * resumes where a cancelled or killed one stopped. Fully deblurred images are kept in the result cache of BaseFilter.
  */
 class DeblurFilter: public BaseFilter {
     Q_OBJECT
 public:
+    ~DeblurFilter();
     void setImage(QImage, QImage, QImage, QImage);
     void setSize(int);
+    int getSize() const;
+    void setTiles(const QVector<QPoint>&);
+    int detectSize(const QVector<int>&);
     virtual void apply() override;
+    void applyRegion(const QRect&);
+    bool isComplete() const;
+signals:
+    void regionUpdated(const QRect &rect, const QImage &tile); /*!< A signal carrying blocks that have been deblurred, so they can be shown before the whole image is done. */
 private:
+    /*!
+     * \brief How far some deblurred blocks are from a valid image.
+     */
+    struct BlockCheck {
+        double integrality = 0; /*!< The total distance of the deblurred values from whole numbers, only used to rank sizes */
+        int outOfRange = 0; /*!< How many deblurred values round to a number outside [0, 255] */
+        double reblur = 0; /*!< The total distance between the rounded values blurred again and the blurred values */
+        int values = 0; /*!< How many values have been checked */
+    };
+
+    /*!
+     * \brief One sample block deblurred with one candidate size while detecting the size.
+     */
+    struct SizeTrial {
+        int size; /*!< The candidate size */
+        int rows; /*!< The number of rows of the sample */
+        int columns; /*!< The number of columns of the sample */
+        QVector<double> red; /*!< The restored red values of the sample, row by row */
+        QVector<double> green; /*!< The restored green values of the sample, row by row */
+        QVector<double> blue; /*!< The restored blue values of the sample, row by row */
+        double score; /*!< How far the deblurred sample is from a valid image, lower is better */
+    };
+    static void scoreTrial(SizeTrial&);
+    static double scoreChannel(const QVector<double>&, int, int, int);
+    static void checkChannel(double**, int, int, int, int, int, const QVector<double>&, BlockCheck&);
+    static QVector<double> copyBlock(double**, int, int, int, int, int);
+    bool validate();
+    static const int VALIDATE_BLOCKS; /*!< How many blocks are checked before any is shown */
+    static const double MAX_OUT_OF_RANGE; /*!< The largest share of values outside [0, 255] the checked blocks may have */
+    static const double MAX_REBLUR; /*!< The largest average disagreement after blurring again the checked blocks may have */
+    static const int SAMPLE_COUNT; /*!< The most sample blocks deblurred for each candidate size */
+    bool checkResidues();
+    bool restoreCached(const QRect&);
+    void restore();
+    void release();
+    void checkpoint();
+    quint64 inputKey() const;
+    QByteArray blockPixels(int, int) const;
+    static const int CHECKPOINT_INTERVAL; /*!< The most time in milliseconds between two writes to the journal */
+    void deblurBlocks(const QRect&);
+    void writeBlock(int, int);
+    static const int PUBLISH_INTERVAL; /*!< The least time in milliseconds between two regionUpdated signals */
+    QImage source; /*!< The image to be deblurred, as it was given */
     QImage redResidue; /*!< The red residue image */
     QImage greenResidue; /*!< The green residue image */
     QImage blueResidue; /*!< The blue residue image */
     int size = 10; /*!< The strength of the filter set by the user */
+    QVector<QPoint> tiles; /*!< The top-left corners of the blurred blocks whose residues are packed, empty if the residues cover the whole image */
+    double **r = nullptr; /*!< The restored red matrix, deblurred block by block */
+    double **g = nullptr; /*!< The restored green matrix, deblurred block by block */
+    double **b = nullptr; /*!< The restored blue matrix, deblurred block by block */
+    int rows = 0; /*!< The number of rows of the restored matrices */
+    QBitArray done; /*!< Which blocks have been deblurred, row by row */
+    BlockCheck check; /*!< What the first blocks deblurred since the matrices were restored look like */
+    int checkedBlocks = 0; /*!< How many blocks have been added to check */
+    DeblurJournal journal; /*!< The finished blocks saved on disk */
+    QVector<int> unsaved; /*!< The finished blocks not yet in the journal */
+    bool cached = false; /*!< Whether the image was taken whole from the result cache */
 };
 
 #endif // DEBLURFILTER_H
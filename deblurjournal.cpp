@@ -0,0 +1,164 @@
+#include "deblurjournal.h"
+#include <QDateTime>
+#include <QDir>
+#include <QStandardPaths>
+
+const quint32 DeblurJournal::MAGIC = 0x44424A4E; // "DBJN"
+
+const qint32 DeblurJournal::VERSION = 1;
+
+const int DeblurJournal::MAX_AGE = 7;
+
+const qint64 DeblurJournal::MAX_SIZE = Q_INT64_C(1024) * 1024 * 1024;
+
+/*!
+ * \brief destructor: write what is pending and close the file, keeping it on disk.
+ */
+DeblurJournal::~DeblurJournal() {
+    close();
+}
+
+/*!
+ * \brief Open the journal of a job, creating it if there is none, and read the blocks already in it.
+ *
+ * A journal whose header does not describe the same job is started over. A journal another job holds is \
+ * left alone, and this job runs without one. Old journals are trimmed first.
+ *
+ * \param key The hash of everything the result depends on
+ * \param width The width of the image
+ * \param height The height of the image
+ * \param size The size of the blocks
+ * \return The index and pixels of every block recorded so far, empty if the journal is new or cannot be written
+ */
+QVector<QPair<int, QByteArray>> DeblurJournal::open(quint64 key, int width, int height, int size) {
+    close();
+    QVector<QPair<int, QByteArray>> blocks;
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/journal";
+    if (!QDir().mkpath(directory)) {
+        return blocks;
+    }
+    trim(directory);
+    QString path = directory + "/" + QString::number(key, 16) + ".deblur";
+    lock.reset(new QLockFile(path + ".lock"));
+    if (!lock->tryLock(0)) {
+        lock.reset();
+        return blocks;
+    }
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite)) {
+        lock.reset();
+        return blocks;
+    }
+    stream.setDevice(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    // Keep the records only if the header matches this job
+    quint32 magic = 0;
+    qint32 version = 0, w = 0, h = 0, sz = 0;
+    quint64 k = 0;
+    stream >> magic >> version >> k >> w >> h >> sz;
+    if (stream.status() != QDataStream::Ok || magic != MAGIC || version != VERSION || k != key
+            || w != width || h != height || sz != size) {
+        file.resize(0);
+        file.seek(0);
+        stream.resetStatus();
+        stream << MAGIC << VERSION << key << static_cast<qint32>(width) << static_cast<qint32>(height)
+                << static_cast<qint32>(size);
+        file.flush();
+        return blocks;
+    }
+
+    // Read up to the last complete record and cut off anything after it
+    qint64 end = file.pos();
+    while (!stream.atEnd()) {
+        qint32 block;
+        QByteArray pixels;
+        stream >> block >> pixels;
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        blocks.append(qMakePair(static_cast<int>(block), pixels));
+        end = file.pos();
+    }
+    stream.resetStatus();
+    file.resize(end);
+    file.seek(end);
+    return blocks;
+}
+
+/*!
+ * \brief Add a deblurred block to the journal. It reaches the disk at the next flush().
+ * \param block The index of the block
+ * \param pixels Its red, green, and blue bytes, row by row
+ */
+void DeblurJournal::append(int block, const QByteArray &pixels) {
+    if (!file.isOpen()) {
+        return;
+    }
+    stream << static_cast<qint32>(block) << pixels;
+}
+
+/*!
+ * \brief Write the appended blocks to the disk.
+ */
+void DeblurJournal::flush() {
+    if (file.isOpen()) {
+        file.flush();
+    }
+}
+
+/*!
+ * \brief Flush and close the journal, keeping it on disk so the job can resume.
+ */
+void DeblurJournal::close() {
+    if (file.isOpen()) {
+        file.flush();
+        file.close();
+    }
+    stream.setDevice(nullptr);
+    lock.reset(); // unlocks
+}
+
+/*!
+ * \brief Close and delete the journal, once the job has finished or its inputs turned out to be wrong.
+ */
+void DeblurJournal::remove() {
+    stream.setDevice(nullptr);
+    if (lock && !file.fileName().isEmpty()) { // only the job holding the journal may delete it
+        file.remove();
+    }
+    lock.reset();
+}
+
+/*!
+ * \brief Delete the journals older than MAX_AGE days, then the oldest until they fit in MAX_SIZE.
+ *
+ * Journals held by a running job are kept whatever their age and size.
+ *
+ * \param directory The directory of the journals
+ */
+void DeblurJournal::trim(const QString &directory) {
+    QDir dir(directory);
+    QFileInfoList journals = dir.entryInfoList(QStringList{"*.deblur"}, QDir::Files, QDir::Time); // newest first
+    QDateTime oldest = QDateTime::currentDateTime().addDays(-MAX_AGE);
+    qint64 total = 0;
+    for (const QFileInfo &journal : journals) {
+        total += journal.size();
+        if (journal.lastModified() >= oldest && total <= MAX_SIZE) {
+            continue;
+        }
+        QLockFile held(journal.filePath() + ".lock");
+        if (held.tryLock(0)) {
+            QFile::remove(journal.filePath());
+            held.unlock(); // removes the lock file
+        }
+    }
+}
+
+/*!
+ * \brief Check if a journal is open.
+ * \return Whether blocks can be appended
+ */
+bool DeblurJournal::isOpen() const {
+    return file.isOpen();
+}
@@ -0,0 +1,44 @@
+#ifndef DEBLURJOURNAL_H
+#define DEBLURJOURNAL_H
+
+#include <QFile>
+#include <QDataStream>
+#include <QByteArray>
+#include <QLockFile>
+#include <QVector>
+#include <QPair>
+#include <memory>
+
+/*!
+ * \brief An append-only file of deblurred blocks, so that a deblur that was cancelled or killed can resume.
+ *
+ * The file is named after a hash of the inputs and kept in the cache directory. It starts with a header \
+ * describing the job, followed by one record per block: its index and its red, green, and blue bytes. \
+ * A record cut short by a crash is dropped when the file is opened again.
+ *
+ * A journal is locked while open, so two jobs on the same inputs do not write over each other: the second \
+ * one runs without a journal. Journals of jobs that were never finished are deleted once older than MAX_AGE \
+ * days, and the oldest go first when they take more than MAX_SIZE together.
+ */
+class DeblurJournal {
+public:
+    DeblurJournal() = default;
+    ~DeblurJournal();
+    QVector<QPair<int, QByteArray>> open(quint64 key, int width, int height, int size);
+    void append(int block, const QByteArray &pixels);
+    void flush();
+    void close();
+    void remove();
+    bool isOpen() const;
+private:
+    static void trim(const QString&);
+    static const int MAX_AGE; /*!< The days a journal is kept after it was last written */
+    static const qint64 MAX_SIZE; /*!< The most disk space kept for journals, in bytes */
+    static const quint32 MAGIC; /*!< The first four bytes of every journal */
+    static const qint32 VERSION; /*!< The version of the record layout */
+    QFile file; /*!< The journal file */
+    QDataStream stream; /*!< Writes records to the file */
+    std::unique_ptr<QLockFile> lock; /*!< Held while the journal is open */
+};
+
+#endif // DEBLURJOURNAL_H
@@ -2,15 +2,29 @@
 
 /*!
  * \brief Apply the filter to uploaded image.
+ *
+ * If the same image was decoded before, the cached result is used instead.
  */
 void DecodeFilter::apply() {
     if (image.isNull()) {
         return;
     }
 
+    // Look for an earlier run on the same image
+    quint64 key = imagehash::image(image, imagehash::bytes("decode", 6));
+    QVector<QImage> cached;
+    if (resultCache().find(key, cached) && cached.size() == 1) {
+        image = cached[0];
+        return;
+    }
+
     // Initialize dynamic arrays
+    FilterTrace::Span span("decode", "unpack");
     int h = image.height();
     int w = image.width();
+    span.setPixels(static_cast<qint64>(h) * w);
+    FilterTrace::add(FilterTrace::Allocations, 3 * (h + 1));
+    FilterTrace::add(FilterTrace::Bytes, 2 * static_cast<qint64>(image.bytesPerLine()) * h); // read, then written back
     int **r = new int*[h];
     int **g = new int*[h];
     int **b = new int*[h];
@@ -31,11 +45,13 @@ void DecodeFilter::apply() {
     }
 
     // Manipulate the red, green, and blue matrices with the method documented in matrix.cpp
+    span.next("transform");
     matrix::decode(r, h, w);
     matrix::decode(g, h, w);
     matrix::decode(b, h, w);
 
     // Construct the original image
+    span.next("pack");
     for (int i = 0; i < h; i++) {
         for (int j = 0; j < w; j++) {
             image.setPixel(j, i, qRgb(r[i][j], g[i][j], b[i][j]));
@@ -51,4 +67,5 @@ void DecodeFilter::apply() {
     delete[] r;
     delete[] g;
     delete[] b;
+    resultCache().insert(key, QVector<QImage>{image});
 }
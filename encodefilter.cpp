@@ -10,13 +10,25 @@ void EncodeFilter::setSecret(QImage img) {
 
 /*!
  * \brief Apply the filter to uploaded images.
+ *
+ * If the same images were encoded before, the cached result is used instead.
  */
 void EncodeFilter::apply() {
     if (image.isNull())
         return;
 
+    // Look for an earlier run on the same images
+    quint64 key = imagehash::image(secret, imagehash::image(image, imagehash::bytes("encode", 6)));
+    QVector<QImage> cached;
+    if (resultCache().find(key, cached) && cached.size() == 1) {
+        image = cached[0];
+        return;
+    }
+
     // Scale the original image to be large enough to cover the entire secret image
+    FilterTrace::Span span("encode", "scale");
     image = image.scaled(secret.size(), Qt::KeepAspectRatioByExpanding);
+    span.setPixels(static_cast<qint64>(image.height()) * image.width());
 
     // The region of source image containing the secret image will have degraded quality.
     // So we degrade all of the source image first to avoid sharp contrast between the region with secret information and the region without
@@ -30,8 +42,12 @@ void EncodeFilter::apply() {
     }
 
     // Initialize dynamic arrays
+    span.next("unpack");
     int h = secret.height();
     int w = secret.width();
+    FilterTrace::add(FilterTrace::Allocations, 6 * (h + 1));
+    FilterTrace::add(FilterTrace::Bytes, static_cast<qint64>(image.bytesPerLine()) * image.height() * 2
+            + static_cast<qint64>(secret.bytesPerLine()) * h); // the base read and written back, the secret read
     int **r = new int*[h];
     int **g = new int*[h];
     int **b = new int*[h];
@@ -62,11 +78,13 @@ void EncodeFilter::apply() {
     }
 
     // Manipulate the red, green, and blue matrices with the method documented in matrix.cpp
+    span.next("transform");
     matrix::encode(r, r2, h, w);
     matrix::encode(g, g2, h, w);
     matrix::encode(b, b2, h, w);
 
     // Construct the cipher image
+    span.next("pack");
     for (int i = 0; i < h; i++) {
         for (int j = 0; j < w; j++) {
             image.setPixel(j, i, qRgb(r[i][j], g[i][j], b[i][j]));
@@ -88,4 +106,5 @@ void EncodeFilter::apply() {
     delete[] g2;
     delete[] b;
     delete[] b2;
+    resultCache().insert(key, QVector<QImage>{image});
 }
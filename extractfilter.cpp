@@ -1,9 +1,27 @@
 #include "extractfilter.h"
+#include <QFile>
 
 /*!
  * \brief Apply the filter to uploaded images.
+ *
+ * If the same GIF file was extracted from before, the cached result is used instead.
  */
 void ExtractFilter::apply() {
+    // Look for an earlier run on the same file
+    quint64 key = 0;
+    QFile file(movie->fileName());
+    bool keyed = file.open(QIODevice::ReadOnly);
+    if (keyed) {
+        QByteArray bytes = file.readAll();
+        key = imagehash::bytes(bytes.constData(), bytes.size(), imagehash::bytes("extract", 7));
+        QVector<QImage> cached;
+        if (resultCache().find(key, cached) && cached.size() == 1) {
+            image = cached[0];
+            return;
+        }
+    }
+
+    FilterTrace::Span span("extract", "read frames");
     movie->jumpToNextFrame();
 
     // Locate the correct frame to be extracted
@@ -17,9 +35,13 @@ void ExtractFilter::apply() {
     image = image2;
 
     // Construct the original image
+    span.next("pack");
     for (int i = 0; i < image.height(); i++) {
         for (int j = 0; j < image.width(); j++) {
             image.setPixel(j, i, movie->currentImage().pixel(j, i));
         }
     }
+    if (keyed) {
+        resultCache().insert(key, QVector<QImage>{image});
+    }
 }
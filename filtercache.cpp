@@ -0,0 +1,185 @@
+#include "filtercache.h"
+#include "imageio.h"
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QTemporaryDir>
+
+const int FilterCache::MEMORY_SIZE = 256 * 1024;
+
+const qint64 FilterCache::DISK_SIZE = Q_INT64_C(2) * 1024 * 1024 * 1024;
+
+const int FilterCache::TRIM_INTERVAL = 64;
+
+/*!
+ * \brief constructor: create an empty cache, with the disk tier on if the settings say so.
+ */
+FilterCache::FilterCache() :
+        memory(MEMORY_SIZE) {
+    root = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/results";
+    diskEnabled = QSettings().value("cache/disk", false).toBool();
+}
+
+/*!
+ * \brief Look up the result of a filter run, in memory first and then on disk.
+ * \param key The hash of the inputs and parameters of the run
+ * \param outputs Set to the images the run produced, if it is found
+ * \return Whether the result was found
+ */
+bool FilterCache::find(quint64 key, QVector<QImage> &outputs) {
+    {
+        QMutexLocker locker(&mutex);
+        if (!enabled) {
+            return false;
+        }
+        QVector<QImage> *cached = memory.object(key);
+        if (cached != nullptr) {
+            outputs = *cached;
+            return true;
+        }
+        if (!diskEnabled) {
+            return false;
+        }
+    }
+
+    // Read the images of the run, named by their position
+    QString path = directory(key);
+    QVector<QImage> loaded;
+    for (int i = 0; QFileInfo::exists(path + "/" + QString::number(i) + ".qoi"); i++) {
+        QImage img = imageio::read(path + "/" + QString::number(i) + ".qoi");
+        if (img.isNull()) {
+            return false;
+        }
+        loaded.append(img);
+    }
+    if (loaded.isEmpty()) {
+        return false;
+    }
+    outputs = loaded;
+    insert(key, loaded);
+    return true;
+}
+
+/*!
+ * \brief Keep the result of a filter run.
+ *
+ * On disk, the images are written to a temporary directory that is renamed once complete, \
+ * so a result is never found half written. The temporary directory has a unique name, since the GUI, \
+ * h22batch and its server share the cache directory. The disk tier is only scanned and trimmed when the \
+ * bytes written since the last scan may have taken it over DISK_SIZE, or every TRIM_INTERVAL results, \
+ * to account for what other processes wrote.
+ *
+ * \param key The hash of the inputs and parameters of the run
+ * \param outputs The images the run produced
+ */
+void FilterCache::insert(quint64 key, const QVector<QImage> &outputs) {
+    qint64 bytes = 0;
+    for (const QImage &img : outputs) {
+        bytes += static_cast<qint64>(img.bytesPerLine()) * img.height();
+    }
+    {
+        QMutexLocker locker(&mutex);
+        if (!enabled) {
+            return;
+        }
+        memory.insert(key, new QVector<QImage>(outputs), qMax<qint64>(1, bytes / 1024)); // cost in kilobytes
+        if (!diskEnabled) {
+            return;
+        }
+    }
+
+    QString path = directory(key);
+    if (QFileInfo::exists(path) || !QDir().mkpath(root)) {
+        return;
+    }
+    QTemporaryDir temporary(path + "-XXXXXX"); // removed unless renamed
+    if (!temporary.isValid()) {
+        return;
+    }
+    qint64 written = 0;
+    for (int i = 0; i < outputs.size(); i++) {
+        QString file = temporary.path() + "/" + QString::number(i) + ".qoi";
+        if (!imageio::write(outputs[i], file)) { // far faster than PNG
+            return;
+        }
+        written += QFileInfo(file).size();
+    }
+    if (!QDir().rename(temporary.path(), path)) {
+        return; // another thread or process kept the same result first
+    }
+
+    QMutexLocker locker(&diskMutex);
+    writes++;
+    if (diskBytes >= 0) {
+        diskBytes += written;
+    }
+    if (diskBytes < 0 || diskBytes > DISK_SIZE || writes >= TRIM_INTERVAL) {
+        trimDisk();
+    }
+}
+
+/*!
+ * \brief Turn the whole cache on or off, e.g. to measure the filters themselves. Not remembered in the settings.
+ * \param on Whether results should be looked up and kept
+ */
+void FilterCache::setEnabled(bool on) {
+    QMutexLocker locker(&mutex);
+    enabled = on;
+    if (!on) {
+        memory.clear();
+    }
+}
+
+/*!
+ * \brief Turn the disk tier on or off, and remember the choice in the settings.
+ * \param on Whether results should also be kept on disk
+ */
+void FilterCache::setDiskEnabled(bool on) {
+    QMutexLocker locker(&mutex);
+    diskEnabled = on;
+    QSettings().setValue("cache/disk", on);
+}
+
+/*!
+ * \brief Check if the disk tier is on.
+ * \return Whether results are also kept on disk
+ */
+bool FilterCache::isDiskEnabled() const {
+    return diskEnabled;
+}
+
+/*!
+ * \brief The directory holding one result on disk.
+ * \param key The hash of the inputs and parameters of the run
+ * \return The path of the directory
+ */
+QString FilterCache::directory(quint64 key) const {
+    return root + "/" + QString::number(key, 16);
+}
+
+/*!
+ * \brief Delete the oldest results on disk until they fit in DISK_SIZE, and measure what is left. Called with diskMutex held.
+ */
+void FilterCache::trimDisk() {
+    QDir dir(root);
+    QFileInfoList results = dir.entryInfoList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Time); // newest first
+    qint64 total = 0;
+    qint64 kept = 0;
+    for (const QFileInfo &result : results) {
+        qint64 bytes = 0;
+        for (const QFileInfo &file : QDir(result.filePath()).entryInfoList(QDir::Files)) {
+            bytes += file.size();
+        }
+        total += bytes;
+        bool abandoned = result.fileName().contains('-') && result.lastModified() < QDateTime::currentDateTime().addDays(-1);
+        if (total > DISK_SIZE || abandoned) { // abandoned: a temporary directory left by a process that stopped
+            QDir(result.filePath()).removeRecursively();
+        } else {
+            kept += bytes;
+        }
+    }
+    diskBytes = kept;
+    writes = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef FILTERCACHE_H
+#define FILTERCACHE_H
+
+#include <QCache>
+#include <QImage>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+/*!
+ * \brief A cache of filter results, keyed by a hash of the inputs and parameters of a filter run.
+ *
+ * Results are kept in memory, least recently used first out, within MEMORY_SIZE. If the disk tier is on \
+ * (setting "cache/disk"), they are also written to the cache directory as QOI files, within DISK_SIZE, \
+ * so that they survive restarting the program. Filters run on worker threads, so every access is locked; \
+ * files are written and the disk tier trimmed outside the lock of the memory tier, so lookups never wait for the disk.
+ */
+class FilterCache {
+public:
+    FilterCache();
+    bool find(quint64, QVector<QImage>&);
+    void insert(quint64, const QVector<QImage>&);
+    void setEnabled(bool);
+    void setDiskEnabled(bool);
+    bool isDiskEnabled() const;
+private:
+    QString directory(quint64) const;
+    void trimDisk();
+    static const int MEMORY_SIZE; /*!< The most memory kept for results, in kilobytes */
+    static const qint64 DISK_SIZE; /*!< The most disk space kept for results, in bytes */
+    static const int TRIM_INTERVAL; /*!< How many results are written between two scans of the disk tier */
+    QCache<quint64, QVector<QImage>> memory; /*!< The results kept in memory */
+    bool enabled = true; /*!< Whether results are looked up and kept at all */
+    bool diskEnabled = false; /*!< Whether results are also kept on disk */
+    QString root; /*!< The directory of the disk tier */
+    QMutex mutex; /*!< Guards the memory tier and the switches */
+    QMutex diskMutex; /*!< Guards diskBytes and writes, and trimming the disk tier */
+    qint64 diskBytes = -1; /*!< The size of the disk tier as of the last scan plus what was written since, -1 before the first scan */
+    int writes = 0; /*!< How many results were written since the last scan */
+};
+
+#endif // FILTERCACHE_H
@@ -0,0 +1,50 @@
+# The filters and the libraries they use, shared by the GUI and the command-line batch tool.
+# They only need QtCore, QtGui and QtConcurrent, so the batch tool runs without a display server.
+
+QT += core gui concurrent
+
+SOURCES += \
+    $$PWD/animationfilter.cpp \
+    $$PWD/basefilter.cpp \
+    $$PWD/blurfilter.cpp \
+    $$PWD/costmodel.cpp \
+    $$PWD/deblurfilter.cpp \
+    $$PWD/deblurjournal.cpp \
+    $$PWD/decodefilter.cpp \
+    $$PWD/encodefilter.cpp \
+    $$PWD/extractfilter.cpp \
+    $$PWD/filtercache.cpp \
+    $$PWD/filtertrace.cpp \
+    $$PWD/gif.cpp \
+    $$PWD/imagehash.cpp \
+    $$PWD/imageio.cpp \
+    $$PWD/insertfilter.cpp \
+    $$PWD/math.cpp \
+    $$PWD/matrix.cpp \
+    $$PWD/perfcounters.cpp \
+    $$PWD/qoicodec.cpp \
+    $$PWD/rawimage.cpp
+
+HEADERS += \
+    $$PWD/animationfilter.h \
+    $$PWD/basefilter.h \
+    $$PWD/blurfilter.h \
+    $$PWD/costmodel.h \
+    $$PWD/deblurfilter.h \
+    $$PWD/deblurjournal.h \
+    $$PWD/decodefilter.h \
+    $$PWD/encodefilter.h \
+    $$PWD/extractfilter.h \
+    $$PWD/filtercache.h \
+    $$PWD/filtertrace.h \
+    $$PWD/gif.h \
+    $$PWD/imagehash.h \
+    $$PWD/imageio.h \
+    $$PWD/insertfilter.h \
+    $$PWD/math.h \
+    $$PWD/matrix.h \
+    $$PWD/perfcounters.h \
+    $$PWD/qoicodec.h \
+    $$PWD/rawimage.h
+
+INCLUDEPATH += $$PWD
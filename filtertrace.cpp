@@ -0,0 +1,359 @@
+#include "filtertrace.h"
+#include <QElapsedTimer>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QMutex>
+#include <QPair>
+#include <QVector>
+#include <memory>
+#include <vector>
+
+std::atomic<bool> FilterTrace::enabled(false);
+
+std::atomic<bool> FilterTrace::profiling(false);
+
+std::atomic<qint64> FilterTrace::counters[FilterTrace::CounterCount];
+
+const int FilterTrace::MAX_EVENTS = 10000;
+
+namespace {
+
+/*!
+ * \brief One finished span.
+ */
+struct TraceEvent {
+    const char *filter; /*!< The filter or library */
+    const char *stage; /*!< The stage */
+    qint64 start; /*!< When it started, in nanoseconds since the clock started */
+    qint64 duration; /*!< How long it took, in nanoseconds */
+    qint64 pixels; /*!< How many pixels it worked on, 0 if unknown */
+    bool profiled; /*!< Whether the hardware events were counted */
+    quint64 events[PerfCounters::EventCount]; /*!< The hardware events counted during the span */
+};
+
+/*!
+ * \brief The sums of the spans of one stage.
+ */
+struct StageTotals {
+    qint64 count = 0; /*!< How many spans */
+    qint64 total = 0; /*!< Their total time, in nanoseconds */
+    qint64 longest = 0; /*!< The longest, in nanoseconds */
+    qint64 pixels = 0; /*!< The pixels of the profiled spans that know their pixels */
+    qint64 profiled = 0; /*!< How many spans counted hardware events */
+    quint64 events[PerfCounters::EventCount] = {}; /*!< The hardware events of the profiled spans */
+    quint64 pixelEvents[PerfCounters::EventCount] = {}; /*!< The hardware events of the profiled spans that know their pixels */
+
+    /*!
+     * \brief Add one span.
+     * \param event The span
+     */
+    void add(const TraceEvent &event) {
+        count++;
+        total += event.duration;
+        longest = qMax(longest, event.duration);
+        if (event.profiled) {
+            profiled++;
+            pixels += event.pixels;
+            for (int k = 0; k < PerfCounters::EventCount; k++) {
+                events[k] += event.events[k];
+                pixelEvents[k] += event.pixels > 0 ? event.events[k] : 0;
+            }
+        }
+    }
+
+    /*!
+     * \brief Add the sums of other spans of the same stage.
+     * \param other The sums
+     */
+    void add(const StageTotals &other) {
+        count += other.count;
+        total += other.total;
+        longest = qMax(longest, other.longest);
+        profiled += other.profiled;
+        pixels += other.pixels;
+        for (int k = 0; k < PerfCounters::EventCount; k++) {
+            events[k] += other.events[k];
+            pixelEvents[k] += other.pixelEvents[k];
+        }
+    }
+};
+
+/*!
+ * \brief The spans recorded by one thread.
+ */
+struct TraceBuffer {
+    int thread; /*!< A small number naming the thread in the trace */
+    QMutex mutex; /*!< Only contended while exporting */
+    QVector<TraceEvent> events; /*!< The spans, in the order they finished */
+    QHash<QPair<const char*, const char*>, StageTotals> totals; /*!< The summed spans, by filter and stage */
+};
+
+QMutex buffersMutex; // guards buffers
+std::vector<std::unique_ptr<TraceBuffer>> buffers; // every thread that has recorded a span, never freed
+
+/*!
+ * \brief The clock every span is timed with, started the first time it is read.
+ * \return The clock
+ */
+QElapsedTimer &traceClock() {
+    static QElapsedTimer timer = [] {
+        QElapsedTimer started;
+        started.start();
+        return started;
+    }();
+    return timer;
+}
+
+/*!
+ * \brief The buffer of the calling thread, made the first time the thread records a span.
+ * \return The buffer
+ */
+TraceBuffer &threadBuffer() {
+    thread_local TraceBuffer *buffer = nullptr;
+    if (buffer == nullptr) {
+        QMutexLocker locker(&buffersMutex);
+        buffers.emplace_back(new TraceBuffer);
+        buffer = buffers.back().get();
+        buffer->thread = static_cast<int>(buffers.size());
+    }
+    return *buffer;
+}
+
+}
+
+/*!
+ * \brief Start or stop recording spans and counters. What was recorded is kept.
+ * \param on Whether to record
+ */
+void FilterTrace::setEnabled(bool on) {
+    traceClock();
+    enabled.store(on);
+}
+
+/*!
+ * \brief Start or stop counting hardware events in every span. Only counts while tracing is enabled too.
+ * \param on Whether to count
+ * \param error Set to why the hardware events cannot be counted, if they cannot
+ * \return Whether profiling is on
+ */
+bool FilterTrace::setProfiling(bool on, QString &error) {
+    if (on && !PerfCounters::open(error)) {
+        on = false;
+    }
+    profiling.store(on);
+    return on;
+}
+
+/*!
+ * \brief Forget every span and reset every counter.
+ */
+void FilterTrace::clear() {
+    QMutexLocker locker(&buffersMutex);
+    for (const std::unique_ptr<TraceBuffer> &buffer : buffers) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        buffer->events.clear();
+        buffer->totals.clear();
+    }
+    for (std::atomic<qint64> &counter : counters) {
+        counter.store(0);
+    }
+}
+
+/*!
+ * \brief The time on the clock of the trace.
+ * \return Nanoseconds since the clock started
+ */
+qint64 FilterTrace::now() {
+    return traceClock().nsecsElapsed();
+}
+
+/*!
+ * \brief Start timing a span, and read the hardware counters if profiling.
+ */
+void FilterTrace::Span::begin() {
+    profiled = profiling.load(std::memory_order_relaxed) && PerfCounters::read(events);
+    start = now(); // last, so reading the counters is not timed
+}
+
+/*!
+ * \brief Keep the finished span in the buffer of the calling thread, or add it to the sums of its stage.
+ */
+void FilterTrace::Span::end() {
+    TraceEvent event;
+    event.duration = now() - start; // first, so reading the counters is not timed
+    quint64 finished[PerfCounters::EventCount];
+    event.profiled = profiled && PerfCounters::read(finished);
+    for (int k = 0; k < PerfCounters::EventCount; k++) {
+        event.events[k] = event.profiled ? finished[k] - events[k] : 0;
+    }
+    event.filter = filter;
+    event.stage = stage;
+    event.start = start;
+    event.pixels = pixels;
+    start = -1;
+
+    TraceBuffer &buffer = threadBuffer();
+    QMutexLocker locker(&buffer.mutex);
+    if (perBlock || buffer.events.size() >= MAX_EVENTS) {
+        buffer.totals[qMakePair(filter, stage)].add(event);
+    } else {
+        buffer.events.append(event);
+    }
+}
+
+/*!
+ * \brief The name of a counter, as shown in the trace and the summary.
+ * \param counter The counter
+ * \return The name
+ */
+const char *FilterTrace::counterName(Counter counter) {
+    switch (counter) {
+    case Blocks:
+        return "blocks";
+    case Pivots:
+        return "rref pivots";
+    case Allocations:
+        return "allocations";
+    case Bytes:
+        return "bytes touched";
+    default:
+        return "";
+    }
+}
+
+/*!
+ * \brief Export the spans and counters in the Chrome trace event format, which Perfetto and chrome://tracing open.
+ *
+ * Summed spans are shown once per thread and stage at the end of the trace, with their count and times as arguments.
+ *
+ * \return The JSON document
+ */
+QByteArray FilterTrace::chromeTrace() {
+    QJsonArray events;
+    qint64 last = 0;
+    QMutexLocker locker(&buffersMutex);
+    for (const std::unique_ptr<TraceBuffer> &buffer : buffers) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        for (const TraceEvent &event : buffer->events) {
+            QJsonObject item;
+            item["name"] = QString::fromLatin1(event.stage);
+            item["cat"] = QString::fromLatin1(event.filter);
+            item["ph"] = "X";
+            item["ts"] = event.start / 1000.0; // microseconds
+            item["dur"] = event.duration / 1000.0;
+            item["pid"] = 1;
+            item["tid"] = buffer->thread;
+            if (event.profiled || event.pixels > 0) {
+                QJsonObject args;
+                if (event.pixels > 0) {
+                    args["pixels"] = static_cast<double>(event.pixels);
+                }
+                for (int k = 0; event.profiled && k < PerfCounters::EventCount; k++) {
+                    args[PerfCounters::name(static_cast<PerfCounters::Event>(k))] = static_cast<double>(event.events[k]);
+                }
+                item["args"] = args;
+            }
+            events.append(item);
+            last = qMax(last, event.start + event.duration);
+        }
+    }
+
+    // The summed spans and the counters are totals, shown once at the end of the trace
+    for (const std::unique_ptr<TraceBuffer> &buffer : buffers) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        for (QHash<QPair<const char*, const char*>, StageTotals>::const_iterator it = buffer->totals.constBegin();
+                it != buffer->totals.constEnd(); ++it) {
+            QJsonObject args;
+            args["count"] = static_cast<double>(it->count);
+            args["total ms"] = it->total / 1e6;
+            args["max ms"] = it->longest / 1e6;
+            QJsonObject item;
+            item["name"] = QString::fromLatin1(it.key().second) + " (summed)";
+            item["cat"] = QString::fromLatin1(it.key().first);
+            item["ph"] = "i";
+            item["s"] = "t";
+            item["ts"] = last / 1000.0;
+            item["pid"] = 1;
+            item["tid"] = buffer->thread;
+            item["args"] = args;
+            events.append(item);
+        }
+    }
+    for (int c = 0; c < CounterCount; c++) {
+        QJsonObject args;
+        args["value"] = static_cast<double>(counters[c].load());
+        QJsonObject item;
+        item["name"] = QString::fromLatin1(counterName(static_cast<Counter>(c)));
+        item["ph"] = "C";
+        item["ts"] = last / 1000.0;
+        item["pid"] = 1;
+        item["args"] = args;
+        events.append(item);
+    }
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+    return QJsonDocument(root).toJson(QJsonDocument::Compact);
+}
+
+/*!
+ * \brief Sum up the spans by filter and stage, and list the counters.
+ * \return One line per stage, with how many times it ran and its total, mean and longest time
+ */
+QString FilterTrace::summary() {
+    QMap<QString, StageTotals> stages; // sorted by name
+    QMutexLocker locker(&buffersMutex);
+    for (const std::unique_ptr<TraceBuffer> &buffer : buffers) {
+        QMutexLocker bufferLocker(&buffer->mutex);
+        for (const TraceEvent &event : buffer->events) {
+            stages[QString::fromLatin1(event.filter) + "/" + QString::fromLatin1(event.stage)].add(event);
+        }
+        for (QHash<QPair<const char*, const char*>, StageTotals>::const_iterator it = buffer->totals.constBegin();
+                it != buffer->totals.constEnd(); ++it) {
+            stages[QString::fromLatin1(it.key().first) + "/" + QString::fromLatin1(it.key().second)].add(it.value());
+        }
+    }
+    bool anyProfiled = false;
+    for (const StageTotals &totals : stages) {
+        anyProfiled = anyProfiled || totals.profiled > 0;
+    }
+
+    QString text = QString("stage").leftJustified(28) + QString("count").rightJustified(10)
+            + QString("total ms").rightJustified(12) + QString("mean ms").rightJustified(12)
+            + QString("max ms").rightJustified(12);
+    if (anyProfiled) {
+        text += QString("Mcycles").rightJustified(12) + QString("IPC").rightJustified(8)
+                + QString("cmiss/px").rightJustified(12) + QString("bmiss/px").rightJustified(12);
+    }
+    text += "\n";
+    for (QMap<QString, StageTotals>::const_iterator it = stages.constBegin(); it != stages.constEnd(); ++it) {
+        text += it.key().leftJustified(28) + QString::number(it->count).rightJustified(10)
+                + QString::number(it->total / 1e6, 'f', 3).rightJustified(12)
+                + QString::number(it->total / 1e6 / it->count, 'f', 3).rightJustified(12)
+                + QString::number(it->longest / 1e6, 'f', 3).rightJustified(12);
+        if (anyProfiled && it->profiled > 0) {
+            quint64 cycles = it->events[PerfCounters::Cycles];
+            text += QString::number(cycles / 1e6, 'f', 3).rightJustified(12)
+                    + (cycles > 0 ? QString::number(double(it->events[PerfCounters::Instructions]) / cycles, 'f', 2)
+                                  : QString("-")).rightJustified(8);
+            if (it->pixels > 0) {
+                text += QString::number(double(it->pixelEvents[PerfCounters::CacheMisses]) / it->pixels, 'f', 4).rightJustified(12)
+                        + QString::number(double(it->pixelEvents[PerfCounters::BranchMisses]) / it->pixels, 'f', 4).rightJustified(12);
+            } else {
+                text += QString("-").rightJustified(12) + QString("-").rightJustified(12);
+            }
+        } else if (anyProfiled) {
+            text += QString("-").rightJustified(12) + QString("-").rightJustified(8)
+                    + QString("-").rightJustified(12) + QString("-").rightJustified(12);
+        }
+        text += "\n";
+    }
+    for (int c = 0; c < CounterCount; c++) {
+        text += QString::fromLatin1(counterName(static_cast<Counter>(c))).leftJustified(28)
+                + QString::number(counters[c].load()).rightJustified(10) + "\n";
+    }
+    return text;
+}
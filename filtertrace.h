@@ -0,0 +1,129 @@
+#ifndef FILTERTRACE_H
+#define FILTERTRACE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include <atomic>
+#include "perfcounters.h"
+
+/*!
+ * \brief Timing spans and counters recorded inside the filters, exported as a Chrome trace and a summary.
+ *
+ * A Span times the scope it lives in, or one stage after another with next(); add() counts blocks, pivots, allocations \
+ * and bytes. With setProfiling(true), spans also count CPU cycles, instructions, cache misses and branch misses \
+ * with PerfCounters, reported per pixel for the spans that know their pixels. Nothing is recorded until \
+ * setEnabled(true). The checks done while disabled are inline in this header, so a disabled span or counter \
+ * only costs one relaxed atomic load.
+ *
+ * Every thread records into its own buffer, so spans on worker threads do not contend. Spans of work repeated \
+ * for every block are only summed per thread and stage, as are the spans of a thread past MAX_EVENTS, so long \
+ * runs keep a bounded trace. Export once the filters being traced have finished.
+ */
+class FilterTrace {
+public:
+    /*!
+     * \brief The quantities counted while tracing.
+     */
+    enum Counter {
+        Blocks, /*!< Blocks blurred or deblurred, per channel */
+        Pivots, /*!< Pivots found by math::rref */
+        Allocations, /*!< Arrays allocated with new[] */
+        Bytes, /*!< Bytes of pixels read or written */
+        CounterCount /*!< The number of counters */
+    };
+
+    /*!
+     * \brief Times the scope it lives in while tracing is enabled, and counts hardware events while profiling.
+     */
+    class Span {
+    public:
+        /*!
+         * \brief constructor: start timing, if tracing is enabled.
+         * \param filter The filter or library, e.g. "deblur", a string literal
+         * \param stage The stage, e.g. "solve", a string literal
+         * \param perBlock Whether the scope runs once per block, so that it is summed rather than recorded one by one
+         */
+        Span(const char *filter, const char *stage, bool perBlock = false) :
+                filter(filter), stage(stage), perBlock(perBlock) {
+            if (isEnabled()) {
+                begin();
+            }
+        }
+
+        /*!
+         * \brief destructor: record the time since the constructor, if it was started.
+         */
+        ~Span() {
+            if (start >= 0) {
+                end();
+            }
+        }
+
+        /*!
+         * \brief End the current stage and start timing the next one, for stages that follow each other in one scope.
+         * \param nextStage The next stage, a string literal
+         */
+        void next(const char *nextStage) {
+            if (start >= 0) {
+                end();
+            }
+            stage = nextStage;
+            if (isEnabled()) {
+                begin();
+            }
+        }
+
+        /*!
+         * \brief Set how many pixels the span works on, so that hardware events can be reported per pixel.
+         * \param count The number of pixels, kept for the stages started with next()
+         */
+        void setPixels(qint64 count) {
+            pixels = count;
+        }
+    private:
+        void begin();
+        void end();
+        const char *filter; /*!< The filter or library */
+        const char *stage; /*!< The stage */
+        bool perBlock; /*!< Whether it is only summed */
+        qint64 start = -1; /*!< When the span started in nanoseconds, -1 if tracing was disabled */
+        qint64 pixels = 0; /*!< How many pixels the span works on, 0 if unknown */
+        quint64 events[PerfCounters::EventCount]; /*!< The hardware counters when the span started, if profiling */
+        bool profiled = false; /*!< Whether the hardware counters were read when the span started */
+    };
+
+    /*!
+     * \brief Check if tracing is enabled.
+     * \return Whether spans and counters are recorded
+     */
+    static bool isEnabled() {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    /*!
+     * \brief Add to a counter, if tracing is enabled.
+     * \param counter The counter
+     * \param amount How much to add
+     */
+    static void add(Counter counter, qint64 amount) {
+        if (isEnabled()) {
+            counters[counter].fetch_add(amount, std::memory_order_relaxed);
+        }
+    }
+
+    static void setEnabled(bool);
+    static bool setProfiling(bool, QString&);
+    static void clear();
+    static QByteArray chromeTrace();
+    static QString summary();
+private:
+    static qint64 now();
+    static const int MAX_EVENTS; /*!< The most spans one thread records one by one, later ones are only summed */
+    static const char *counterName(Counter);
+    static std::atomic<bool> enabled; /*!< Whether spans and counters are recorded */
+    static std::atomic<bool> profiling; /*!< Whether spans also count hardware events */
+    static std::atomic<qint64> counters[CounterCount]; /*!< The totals of the counters since the last clear() */
+};
+
+#endif // FILTERTRACE_H
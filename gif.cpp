@@ -1,5 +1,10 @@
 #include "gif.h"
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 // max, min, and abs functions
 int GifIMax(int l, int r) {
     return l > r ? l : r;
@@ -407,6 +412,100 @@ void GifDitherImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
     GIF_TEMP_FREE(quantPixels);
 }
 
+// 8x8 Bayer threshold matrix, values 0-63
+static const uint8_t kGifBayer[8][8] = {
+    {  0, 32,  8, 40,  2, 34, 10, 42 },
+    { 48, 16, 56, 24, 50, 18, 58, 26 },
+    { 12, 44,  4, 36, 14, 46,  6, 38 },
+    { 60, 28, 52, 20, 62, 30, 54, 22 },
+    {  3, 35, 11, 43,  1, 33,  9, 41 },
+    { 51, 19, 59, 27, 49, 17, 57, 25 },
+    { 15, 47,  7, 39, 13, 45,  5, 37 },
+    { 63, 31, 55, 23, 61, 29, 53, 21 }
+};
+
+// closest palette index to a 15-bit color key, searched with the center of its 8x8x8 cell
+uint8_t GifClosestKeyColor(GifPalette *pPal, int key) {
+    int rr = ((key >> 10) & 31) * 8 + 4;
+    int gg = ((key >> 5) & 31) * 8 + 4;
+    int bb = (key & 31) * 8 + 4;
+    int32_t bestDiff = 1000000;
+    int32_t bestInd = 1;
+    GifGetClosestPaletteColor(pPal, rr, gg, bb, bestInd, bestDiff);
+    return (uint8_t) bestInd;
+}
+
+// Implements ordered (8x8 Bayer matrix) dithering, writes palette value to alpha.
+// Each pixel only depends on its own color and position, so the per-row arithmetic is
+// written to auto-vectorize. Whole frames run in parallel through GifSetThreads.
+void GifOrderedDitherImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t width, uint32_t height, GifPalette *pPal) {
+    // The thresholds span about half the distance between neighbouring colors of a uniform
+    // palette of this size; median split palettes are denser than that where it matters
+    int levels = 1;
+    while ((levels + 1) * (levels + 1) * (levels + 1) <= (1 << pPal->bitDepth))
+        ++levels;
+    const int spread = 256 / levels;
+    int offsets[64];
+    for (int ii = 0; ii < 64; ++ii)
+        offsets[ii] = (kGifBayer[ii / 8][ii % 8] * 2 - 63) * spread / 256;
+
+    // On frames with more pixels than 15-bit colors, search once per color instead of
+    // once per pixel; on smaller ones filling the table would cost more searches
+    const int numKeys = 1 << 15;
+    uint8_t *lookup = NULL;
+    if ((size_t) width * height > (size_t) numKeys) {
+        lookup = (uint8_t*) GIF_TEMP_MALLOC(numKeys);
+        for (int key = 0; key < numKeys; ++key)
+            lookup[key] = GifClosestKeyColor(pPal, key);
+    }
+    uint16_t *keys = (uint16_t*) GIF_TEMP_MALLOC(sizeof(uint16_t) * width);
+
+    for (uint32_t yy = 0; yy < height; ++yy) {
+        const uint8_t *src = nextFrame + (size_t) yy * width * 4;
+        const uint8_t *last = lastFrame ? lastFrame + (size_t) yy * width * 4 : NULL;
+        uint8_t *dst = outFrame + (size_t) yy * width * 4;
+        const int *rowOffsets = offsets + (yy & 7) * 8;
+
+        // add the threshold for each position and reduce to a 15-bit color key.
+        // no branches or calls in here, so the compiler can vectorize it
+        for (uint32_t xx = 0; xx < width; ++xx) {
+            int off = rowOffsets[xx & 7];
+            int rr = src[xx * 4 + 0] + off;
+            int gg = src[xx * 4 + 1] + off;
+            int bb = src[xx * 4 + 2] + off;
+            rr = rr < 0 ? 0 : (rr > 255 ? 255 : rr);
+            gg = gg < 0 ? 0 : (gg > 255 ? 255 : gg);
+            bb = bb < 0 ? 0 : (bb > 255 ? 255 : bb);
+            keys[xx] = (uint16_t) (((rr >> 3) << 10) | ((gg >> 3) << 5) | (bb >> 3));
+        }
+
+        for (uint32_t xx = 0; xx < width; ++xx) {
+            // if a previous color is available, and it matches the current color,
+            // set the pixel to transparent
+            if (last && last[xx * 4 + 0] == src[xx * 4 + 0]
+                    && last[xx * 4 + 1] == src[xx * 4 + 1]
+                    && last[xx * 4 + 2] == src[xx * 4 + 2]) {
+                dst[xx * 4 + 0] = last[xx * 4 + 0];
+                dst[xx * 4 + 1] = last[xx * 4 + 1];
+                dst[xx * 4 + 2] = last[xx * 4 + 2];
+                dst[xx * 4 + 3] = kGifTransIndex;
+                continue;
+            }
+
+            uint8_t ind = lookup ? lookup[keys[xx]] : GifClosestKeyColor(pPal, keys[xx]);
+            dst[xx * 4 + 0] = pPal->r[ind];
+            dst[xx * 4 + 1] = pPal->g[ind];
+            dst[xx * 4 + 2] = pPal->b[ind];
+            dst[xx * 4 + 3] = ind;
+        }
+    }
+
+    GIF_TEMP_FREE(keys);
+    if (lookup)
+        GIF_TEMP_FREE(lookup);
+}
+
 // Picks palette colors for the image using simple thresholding, no dithering
 void GifThresholdImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
         uint8_t *outFrame, uint32_t width, uint32_t height, GifPalette *pPal) {
@@ -497,8 +596,14 @@ void GifWritePalette(const GifPalette *pPal, FILE *f) {
 }
 
 // write the image header, LZW-compress and write out the image
+// image points at the top-left pixel of the rectangle being written; stride is the
+// distance between its rows in pixels, 0 meaning the image is exactly width pixels wide
 void GifWriteLzwImage(FILE *f, uint8_t *image, uint32_t left, uint32_t top,
-        uint32_t width, uint32_t height, uint32_t delay, GifPalette *pPal) {
+        uint32_t width, uint32_t height, uint32_t delay, GifPalette *pPal,
+        uint32_t stride) {
+    if (stride == 0)
+        stride = width;
+
     // graphics control extension
     fputc(0x21, f);
     fputc(0xf9, f);
@@ -551,10 +656,10 @@ void GifWriteLzwImage(FILE *f, uint8_t *image, uint32_t left, uint32_t top,
         for (uint32_t xx = 0; xx < width; ++xx) {
 #ifdef GIF_FLIP_VERT
             // bottom-left origin image (such as an OpenGL capture)
-            uint8_t nextValue = image[((height-1-yy)*width+xx)*4+3];
+            uint8_t nextValue = image[((height-1-yy)*stride+xx)*4+3];
     #else
             // top-left origin
-            uint8_t nextValue = image[(yy * width + xx) * 4 + 3];
+            uint8_t nextValue = image[(yy * stride + xx) * 4 + 3];
 #endif
 
             // "loser mode" - no compression, every single code is followed immediately by a clear
@@ -609,6 +714,445 @@ void GifWriteLzwImage(FILE *f, uint8_t *image, uint32_t left, uint32_t top,
     GIF_TEMP_FREE(codetree);
 }
 
+// Finds the bounding box of the pixels of a palettized frame that are not transparent,
+// i.e. the part of the canvas that the frame actually changes.
+// Returns false if the whole frame is transparent.
+bool GifFindChangedRect(const uint8_t *frame, uint32_t width, uint32_t height,
+        GifRect *rect) {
+    uint32_t minX = width, maxX = 0;
+    uint32_t minY = height, maxY = 0;
+
+    for (uint32_t yy = 0; yy < height; ++yy) {
+        const uint8_t *row = frame + (size_t) yy * width * 4;
+
+        // find the first and last changed pixel of the row
+        uint32_t first = 0;
+        while (first < width && row[first * 4 + 3] == kGifTransIndex)
+            ++first;
+        if (first == width)
+            continue;
+        uint32_t last = width - 1;
+        while (row[last * 4 + 3] == kGifTransIndex)
+            --last;
+
+        if (first < minX)
+            minX = first;
+        if (last > maxX)
+            maxX = last;
+        if (yy < minY)
+            minY = yy;
+        maxY = yy;
+    }
+
+    if (minY == height)
+        return false;
+
+    rect->left = minX;
+    rect->top = minY;
+    rect->width = maxX - minX + 1;
+    rect->height = maxY - minY + 1;
+    return true;
+}
+
+// Checks whether two frames have the same color at every pixel (alpha is ignored)
+bool GifSameFrame(const uint8_t *frameA, const uint8_t *frameB,
+        uint32_t numPixels) {
+    for (uint32_t ii = 0; ii < numPixels; ++ii) {
+        if (frameA[0] != frameB[0] || frameA[1] != frameB[1]
+                || frameA[2] != frameB[2])
+            return false;
+        frameA += 4;
+        frameB += 4;
+    }
+    return true;
+}
+
+// Writes a palettized frame, compressing only the rectangle it changes.
+// A frame that changes nothing (or a NULL frame, for a duplicate that was never quantized)
+// is merged into the previous one by rewriting that frame's delay in place.
+void GifEmitFrame(GifWriter *writer, uint8_t *frame, uint32_t delay,
+        GifPalette *pPal) {
+    GifRect rect;
+    bool changed = frame
+            && GifFindChangedRect(frame, writer->width, writer->height, &rect);
+
+    if (!changed && writer->lastDelayPos >= 0
+            && writer->lastDelay + delay <= 0xffff) {
+        writer->lastDelay += delay;
+        fseek(writer->f, writer->lastDelayPos, SEEK_SET);
+        fputc(writer->lastDelay & 0xff, writer->f);
+        fputc((writer->lastDelay >> 8) & 0xff, writer->f);
+        fseek(writer->f, 0, SEEK_END);
+        return;
+    }
+
+    // nothing to merge into (or the delay would overflow): write a single transparent pixel
+    uint8_t transparentPixel[4] = { 0, 0, 0, kGifTransIndex };
+    GifPalette transparentPal;
+    if (!changed) {
+        rect.left = rect.top = 0;
+        rect.width = rect.height = 1;
+        if (!frame) {
+            memset(&transparentPal, 0, sizeof(transparentPal));
+            transparentPal.bitDepth = 2; // the smallest LZW code size GIF allows
+            frame = transparentPixel;
+            pPal = &transparentPal;
+        }
+    }
+
+    writer->lastDelayPos = ftell(writer->f) + 4; // the delay follows the 4-byte graphics control extension header
+    writer->lastDelay = delay;
+    GifWriteLzwImage(writer->f,
+            frame + ((size_t) rect.top * writer->width + rect.left) * 4,
+            rect.left, rect.top, rect.width, rect.height, delay, pPal,
+            writer->width);
+}
+
+// The smallest palette bit depth with room for numColors colors besides the transparency
+// index. Never less than 2, the smallest LZW code size GIF allows.
+int GifSmallestBitDepth(int numColors) {
+    int bitDepth = 2;
+    while (bitDepth < 8 && numColors >= (1 << bitDepth))
+        ++bitDepth;
+    return bitDepth;
+}
+
+// Tries to palettize a frame without loss: collects the distinct colors of the pixels that
+// changed since lastFrame and, if there are few enough to fit a palette of maxBitDepth,
+// uses exactly those colors at the smallest bit depth that holds them.
+// Returns false, leaving outFrame untouched, if there are too many colors.
+// lastFrame and outFrame may be the same buffer.
+bool GifExactPaletteImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t width, uint32_t height, int maxBitDepth,
+        GifPalette *pPal) {
+    const uint32_t numPixels = width * height;
+    const int maxColors = (1 << maxBitDepth) - 1;
+
+    // open addressing hash set of 24-bit colors, stored plus one so that 0 means empty
+    const uint32_t hashSize = 1024;
+    uint32_t keys[hashSize];
+    uint8_t values[hashSize];
+    memset(keys, 0, sizeof(keys));
+    int numColors = 0;
+
+    for (uint32_t ii = 0; ii < numPixels; ++ii) {
+        const uint8_t *pix = nextFrame + ii * 4;
+        const uint8_t *last = lastFrame ? lastFrame + ii * 4 : NULL;
+        if (last && last[0] == pix[0] && last[1] == pix[1] && last[2] == pix[2])
+            continue;
+
+        uint32_t key = ((uint32_t) pix[0] << 16 | (uint32_t) pix[1] << 8 | pix[2])
+                + 1;
+        uint32_t slot = (key * 2654435761u) >> 22;
+        while (keys[slot] && keys[slot] != key)
+            slot = (slot + 1) & (hashSize - 1);
+        if (keys[slot])
+            continue;
+
+        if (++numColors > maxColors)
+            return false;
+        keys[slot] = key;
+        values[slot] = (uint8_t) numColors;
+    }
+
+    memset(pPal, 0, sizeof(GifPalette));
+    pPal->bitDepth = GifSmallestBitDepth(numColors);
+    for (uint32_t slot = 0; slot < hashSize; ++slot) {
+        if (!keys[slot])
+            continue;
+        pPal->r[values[slot]] = (uint8_t) ((keys[slot] - 1) >> 16);
+        pPal->g[values[slot]] = (uint8_t) ((keys[slot] - 1) >> 8);
+        pPal->b[values[slot]] = (uint8_t) (keys[slot] - 1);
+    }
+
+    for (uint32_t ii = 0; ii < numPixels; ++ii) {
+        const uint8_t *pix = nextFrame + ii * 4;
+        const uint8_t *last = lastFrame ? lastFrame + ii * 4 : NULL;
+        uint8_t *out = outFrame + ii * 4;
+        if (last && last[0] == pix[0] && last[1] == pix[1] && last[2] == pix[2]) {
+            out[0] = last[0];
+            out[1] = last[1];
+            out[2] = last[2];
+            out[3] = kGifTransIndex;
+            continue;
+        }
+
+        uint32_t key = ((uint32_t) pix[0] << 16 | (uint32_t) pix[1] << 8 | pix[2])
+                + 1;
+        uint32_t slot = (key * 2654435761u) >> 22;
+        while (keys[slot] != key)
+            slot = (slot + 1) & (hashSize - 1);
+        out[0] = pix[0];
+        out[1] = pix[1];
+        out[2] = pix[2];
+        out[3] = values[slot];
+    }
+
+    return true;
+}
+
+// Expands an indexed frame to RGBA with the palette index in alpha.
+// Only the colors the frame actually uses go into the palette, renumbered from 1 up,
+// since index 0 is reserved for transparency.
+// Returns false (leaving just the RGB filled in) if the frame uses all 256 colors.
+bool GifExpandIndexedFrame(const uint8_t *indices, const uint32_t *colors,
+        int numColors, uint32_t numPixels, uint8_t *outFrame, int bitDepth,
+        bool smallestDepth, GifPalette *pPal) {
+    bool used[256];
+    memset(used, 0, sizeof(used));
+    for (uint32_t ii = 0; ii < numPixels; ++ii)
+        used[indices[ii]] = true;
+
+    if (smallestDepth) {
+        int totalUsed = 0;
+        for (int ii = 0; ii < 256; ++ii)
+            totalUsed += used[ii];
+        bitDepth = GifIMin(bitDepth, GifSmallestBitDepth(totalUsed));
+    }
+
+    uint8_t remap[256];
+    int numUsed = 0;
+    memset(pPal, 0, sizeof(GifPalette));
+    pPal->bitDepth = bitDepth;
+    for (int ii = 0; ii < 256; ++ii) {
+        if (!used[ii])
+            continue;
+        ++numUsed;
+        remap[ii] = (uint8_t) numUsed;
+        if (numUsed < (1 << bitDepth)) {
+            uint32_t color = ii < numColors ? colors[ii] : 0;
+            pPal->r[numUsed] = (uint8_t) (color >> 16);
+            pPal->g[numUsed] = (uint8_t) (color >> 8);
+            pPal->b[numUsed] = (uint8_t) color;
+        }
+    }
+
+    for (uint32_t ii = 0; ii < numPixels; ++ii) {
+        uint32_t color = indices[ii] < numColors ? colors[indices[ii]] : 0;
+        outFrame[ii * 4 + 0] = (uint8_t) (color >> 16);
+        outFrame[ii * 4 + 1] = (uint8_t) (color >> 8);
+        outFrame[ii * 4 + 2] = (uint8_t) color;
+        outFrame[ii * 4 + 3] = remap[indices[ii]];
+    }
+
+    return numUsed < (1 << bitDepth);
+}
+
+// Delta-encodes a frame that already has its palette index in alpha:
+// pixels with the same color as in lastFrame become transparent.
+// lastFrame and outFrame may be the same buffer.
+void GifDeltaIndexedFrame(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t numPixels) {
+    for (uint32_t ii = 0; ii < numPixels; ++ii) {
+        if (lastFrame && lastFrame[0] == nextFrame[0]
+                && lastFrame[1] == nextFrame[1]
+                && lastFrame[2] == nextFrame[2]) {
+            outFrame[0] = lastFrame[0];
+            outFrame[1] = lastFrame[1];
+            outFrame[2] = lastFrame[2];
+            outFrame[3] = kGifTransIndex;
+        } else {
+            outFrame[0] = nextFrame[0];
+            outFrame[1] = nextFrame[1];
+            outFrame[2] = nextFrame[2];
+            outFrame[3] = nextFrame[3];
+        }
+
+        if (lastFrame)
+            lastFrame += 4;
+        outFrame += 4;
+        nextFrame += 4;
+    }
+}
+
+// Builds a palette for a frame and palettizes it into outFrame (palette index in alpha).
+// This is everything GifWriteFrame does before LZW compression, and it only depends on
+// the frame itself and the delta base lastFrame, so it can run on any thread.
+void GifQuantizeFrame(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t width, uint32_t height, int bitDepth,
+        bool dither, GifPalette *pPal, GifDitherMode ditherMode,
+        GifDepthPreset depthPreset) {
+    if (depthPreset != kGifDepthFixed
+            && GifExactPaletteImage(lastFrame, nextFrame, outFrame, width,
+                    height, bitDepth, pPal))
+        return;
+    if (depthPreset == kGifDepthSpeed)
+        bitDepth = GifIMin(bitDepth, 6);
+
+    GifMakePalette((dither ? NULL : lastFrame), nextFrame, width, height,
+            bitDepth, dither, pPal);
+
+    if (dither && ditherMode == kGifDitherOrdered)
+        GifOrderedDitherImage(lastFrame, nextFrame, outFrame, width, height,
+                pPal);
+    else if (dither)
+        GifDitherImage(lastFrame, nextFrame, outFrame, width, height, pPal);
+    else
+        GifThresholdImage(lastFrame, nextFrame, outFrame, width, height, pPal);
+}
+
+// One frame travelling through the multi-threaded encoder
+struct GifFrameJob {
+    uint8_t *image; // copy of the input frame
+    uint8_t *base;  // copy of the previous input frame, the delta base
+    uint8_t *out;   // quantized frame, palette index in alpha
+    bool hasBase;
+    bool indexed;   // image came from GifWriteIndexedFrame: palette index already in alpha, pal already built
+    bool duplicate; // same as the delta base, so it was not quantized at all
+    bool done;
+    uint32_t delay;
+    int bitDepth;
+    bool dither;
+    GifDitherMode ditherMode;
+    GifDepthPreset depthPreset;
+    GifPalette pal;
+};
+
+// The jobs form a ring buffer indexed by frame number.
+// Frames [nextEmit, nextSubmit) are in flight, frames [nextWork, nextSubmit) have not been
+// picked up by a worker yet.
+struct GifPipeline {
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable workReady; // a frame was submitted, or the workers should quit
+    std::condition_variable jobDone;   // a worker finished a frame
+
+    GifFrameJob *jobs;
+    uint32_t numJobs;
+    uint64_t nextSubmit;
+    uint64_t nextWork;
+    uint64_t nextEmit;
+
+    bool quit;
+};
+
+// worker thread body: quantize frames until told to quit
+void GifPipelineWorker(GifPipeline *pipe, uint32_t width, uint32_t height) {
+    std::unique_lock<std::mutex> lock(pipe->mutex);
+    for (;;) {
+        while (!pipe->quit && pipe->nextWork == pipe->nextSubmit)
+            pipe->workReady.wait(lock);
+        if (pipe->quit)
+            return;
+
+        GifFrameJob &job = pipe->jobs[pipe->nextWork++ % pipe->numJobs];
+        lock.unlock();
+        job.duplicate = job.hasBase
+                && GifSameFrame(job.base, job.image, width * height);
+        if (!job.duplicate && job.indexed)
+            GifDeltaIndexedFrame(job.hasBase ? job.base : NULL, job.image,
+                    job.out, width * height);
+        else if (!job.duplicate)
+            GifQuantizeFrame(job.hasBase ? job.base : NULL, job.image, job.out,
+                    width, height, job.bitDepth, job.dither, &job.pal,
+                    job.ditherMode, job.depthPreset);
+        lock.lock();
+
+        job.done = true;
+        pipe->jobDone.notify_all();
+    }
+}
+
+// waits for the oldest frame in flight and writes it out
+void GifPipelineEmit(GifWriter *writer) {
+    GifPipeline *pipe = writer->pipeline;
+    GifFrameJob *job;
+    {
+        std::unique_lock<std::mutex> lock(pipe->mutex);
+        job = &pipe->jobs[pipe->nextEmit % pipe->numJobs];
+        while (!job->done)
+            pipe->jobDone.wait(lock);
+    }
+
+    // only this thread touches the file and frees slots, so no lock is needed to write
+    GifEmitFrame(writer, job->duplicate ? NULL : job->out, job->delay,
+            &job->pal);
+
+    std::unique_lock<std::mutex> lock(pipe->mutex);
+    job->done = false;
+    ++pipe->nextEmit;
+}
+
+// returns the slot for the next frame, writing out finished frames to make room if needed
+GifFrameJob* GifPipelineAcquire(GifWriter *writer) {
+    GifPipeline *pipe = writer->pipeline;
+
+    // nextSubmit and nextEmit are only changed by this thread
+    if (pipe->nextSubmit - pipe->nextEmit == pipe->numJobs)
+        GifPipelineEmit(writer);
+
+    return &pipe->jobs[pipe->nextSubmit % pipe->numJobs];
+}
+
+// hands the frame filled into the slot from GifPipelineAcquire to the workers
+void GifPipelineCommit(GifWriter *writer, GifFrameJob *job, uint32_t delay) {
+    GifPipeline *pipe = writer->pipeline;
+    const size_t imageSize = (size_t) writer->width * writer->height * 4;
+
+    if (!writer->firstFrame)
+        memcpy(job->base, writer->lastImage, imageSize);
+    job->hasBase = !writer->firstFrame;
+    job->delay = delay;
+
+    memcpy(writer->lastImage, job->image, imageSize);
+    writer->firstFrame = false;
+
+    {
+        std::unique_lock<std::mutex> lock(pipe->mutex);
+        ++pipe->nextSubmit;
+        pipe->workReady.notify_one();
+    }
+
+    // write out whatever is already finished, without waiting
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(pipe->mutex);
+            if (pipe->nextEmit == pipe->nextSubmit
+                    || !pipe->jobs[pipe->nextEmit % pipe->numJobs].done)
+                break;
+        }
+        GifPipelineEmit(writer);
+    }
+}
+
+// hands a frame to the workers, writing out finished frames to make room if needed
+void GifPipelineSubmit(GifWriter *writer, const uint8_t *image, uint32_t delay,
+        int bitDepth, bool dither) {
+    GifFrameJob *job = GifPipelineAcquire(writer);
+    memcpy(job->image, image, (size_t) writer->width * writer->height * 4);
+    job->indexed = false;
+    job->bitDepth = bitDepth;
+    job->dither = dither;
+    job->ditherMode = writer->ditherMode;
+    job->depthPreset = writer->depthPreset;
+    GifPipelineCommit(writer, job, delay);
+}
+
+// writes out all frames in flight, stops the workers and frees the pipeline
+void GifPipelineFinish(GifWriter *writer) {
+    GifPipeline *pipe = writer->pipeline;
+    while (pipe->nextEmit != pipe->nextSubmit)
+        GifPipelineEmit(writer);
+
+    {
+        std::unique_lock<std::mutex> lock(pipe->mutex);
+        pipe->quit = true;
+        pipe->workReady.notify_all();
+    }
+    for (size_t ii = 0; ii < pipe->workers.size(); ++ii)
+        pipe->workers[ii].join();
+
+    for (uint32_t ii = 0; ii < pipe->numJobs; ++ii) {
+        GIF_FREE(pipe->jobs[ii].image);
+        GIF_FREE(pipe->jobs[ii].base);
+        GIF_FREE(pipe->jobs[ii].out);
+    }
+    delete[] pipe->jobs;
+    delete pipe;
+
+    writer->pipeline = NULL;
+}
+
 // Creates a gif file.
 // The input GIFWriter is assumed to be uninitialized.
 // The delay value is the time between frames in hundredths of a second - note that not all viewers pay much attention to this value.
@@ -626,9 +1170,17 @@ bool GifBegin(GifWriter *writer, const char *filename, uint32_t width,
         return false;
 
     writer->firstFrame = true;
+    writer->width = width;
+    writer->height = height;
+    writer->pipeline = NULL;
+    writer->lastDelayPos = -1;
+    writer->lastDelay = 0;
+    writer->ditherMode = kGifDitherFloydSteinberg;
+    writer->depthPreset = kGifDepthFixed;
 
     // allocate
     writer->oldImage = (uint8_t*) GIF_MALLOC(width * height * 4);
+    writer->lastImage = (uint8_t*) GIF_MALLOC(width * height * 4);
 
     fputs("GIF89a", writer->f);
 
@@ -679,22 +1231,139 @@ bool GifWriteFrame(GifWriter *writer, const uint8_t *image, uint32_t width,
     if (!writer->f)
         return false;
 
+    if (writer->pipeline) {
+        GifPipelineSubmit(writer, image, delay, bitDepth, dither);
+        return true;
+    }
+
     const uint8_t *oldImage = writer->firstFrame ? NULL : writer->oldImage;
+
+    // an identical frame leaves the canvas as it is, so skip the palette work entirely
+    if (!writer->firstFrame
+            && GifSameFrame(writer->lastImage, image, width * height)) {
+        GifEmitFrame(writer, NULL, delay, NULL);
+        return true;
+    }
+    memcpy(writer->lastImage, image, (size_t) width * height * 4);
     writer->firstFrame = false;
 
     GifPalette pal;
-    GifMakePalette((dither ? NULL : oldImage), image, width, height, bitDepth,
-            dither, &pal);
+    GifQuantizeFrame(oldImage, image, writer->oldImage, width, height, bitDepth,
+            dither, &pal, writer->ditherMode, writer->depthPreset);
 
-    if (dither)
-        GifDitherImage(oldImage, image, writer->oldImage, width, height, &pal);
-    else
-        GifThresholdImage(oldImage, image, writer->oldImage, width, height,
-                &pal);
+    GifEmitFrame(writer, writer->oldImage, delay, &pal);
+
+    return true;
+}
+
+// Switches a GIF in progress to multi-threaded encoding.
+// Palette building and quantization run on numThreads worker threads (0 picks one per core),
+// while GifWriteFrame and GifEnd still LZW-compress and write the frames in order on the
+// calling thread. At most maxFramesInFlight frames are buffered, so GifWriteFrame blocks
+// when the workers fall that far behind.
+bool GifSetThreads(GifWriter *writer, int numThreads, int maxFramesInFlight) {
+    if (!writer->f || !writer->firstFrame || writer->pipeline)
+        return false;
+
+    if (numThreads <= 0)
+        numThreads = (int) std::thread::hardware_concurrency();
+    if (numThreads <= 0)
+        numThreads = 1;
+    if (maxFramesInFlight < numThreads + 1)
+        maxFramesInFlight = numThreads + 1; // keep every worker busy while one frame is written
+
+    const size_t imageSize = (size_t) writer->width * writer->height * 4;
+
+    GifPipeline *pipe = new GifPipeline;
+    pipe->numJobs = (uint32_t) maxFramesInFlight;
+    pipe->jobs = new GifFrameJob[pipe->numJobs];
+    for (uint32_t ii = 0; ii < pipe->numJobs; ++ii) {
+        pipe->jobs[ii].image = (uint8_t*) GIF_MALLOC(imageSize);
+        pipe->jobs[ii].base = (uint8_t*) GIF_MALLOC(imageSize);
+        pipe->jobs[ii].out = (uint8_t*) GIF_MALLOC(imageSize);
+        pipe->jobs[ii].done = false;
+    }
+    pipe->nextSubmit = pipe->nextWork = pipe->nextEmit = 0;
+    pipe->quit = false;
+
+    writer->pipeline = pipe;
+    for (int ii = 0; ii < numThreads; ++ii)
+        pipe->workers.push_back(
+                std::thread(GifPipelineWorker, pipe, writer->width,
+                        writer->height));
+
+    return true;
+}
+
+// Chooses how frames written with dither = true are dithered.
+// The default is Floyd-Steinberg; ordered dithering is much faster on large frames.
+bool GifSetDitherMode(GifWriter *writer, GifDitherMode mode) {
+    if (!writer->f)
+        return false;
+
+    writer->ditherMode = mode;
+    return true;
+}
 
-    GifWriteLzwImage(writer->f, writer->oldImage, 0, 0, width, height, delay,
-            &pal);
+// Writes out a frame that is already palettized, given as one palette index per pixel
+// and its color table (0xAARRGGBB, alpha ignored, as in QImage::colorTable()).
+// Palette building and quantization are skipped, so the colors are written exactly.
+// Frames that use all 256 colors leave no room for the transparency index and go
+// through GifWriteFrame instead.
+bool GifWriteIndexedFrame(GifWriter *writer, const uint8_t *indices,
+        const uint32_t *colors, int numColors, uint32_t width, uint32_t height,
+        uint32_t delay) {
+    if (!writer->f)
+        return false;
+
+    const uint32_t numPixels = width * height;
+    const int bitDepth = 8;
+
+    if (writer->pipeline) {
+        GifFrameJob *job = GifPipelineAcquire(writer);
+        // if the colors don't fit, the expanded frame is quantized like any other
+        job->indexed = GifExpandIndexedFrame(indices, colors, numColors,
+                numPixels, job->image, bitDepth,
+                writer->depthPreset != kGifDepthFixed, &job->pal);
+        job->bitDepth = bitDepth;
+        job->dither = false;
+        job->ditherMode = writer->ditherMode;
+        job->depthPreset = writer->depthPreset;
+        GifPipelineCommit(writer, job, delay);
+        return true;
+    }
+
+    uint8_t *expanded = (uint8_t*) GIF_TEMP_MALLOC((size_t) numPixels * 4);
+    GifPalette pal;
+    if (!GifExpandIndexedFrame(indices, colors, numColors, numPixels, expanded,
+            bitDepth, writer->depthPreset != kGifDepthFixed, &pal)) {
+        bool result = GifWriteFrame(writer, expanded, width, height, delay,
+                bitDepth);
+        GIF_TEMP_FREE(expanded);
+        return result;
+    }
 
+    if (!writer->firstFrame
+            && GifSameFrame(writer->lastImage, expanded, numPixels)) {
+        GifEmitFrame(writer, NULL, delay, NULL);
+    } else {
+        memcpy(writer->lastImage, expanded, (size_t) numPixels * 4);
+        GifDeltaIndexedFrame(writer->firstFrame ? NULL : writer->oldImage,
+                expanded, writer->oldImage, numPixels);
+        writer->firstFrame = false;
+        GifEmitFrame(writer, writer->oldImage, delay, &pal);
+    }
+
+    GIF_TEMP_FREE(expanded);
+    return true;
+}
+
+// Chooses how the palette size of each frame is picked, see GifDepthPreset
+bool GifSetDepthPreset(GifWriter *writer, GifDepthPreset preset) {
+    if (!writer->f)
+        return false;
+
+    writer->depthPreset = preset;
     return true;
 }
 
@@ -705,12 +1374,17 @@ bool GifEnd(GifWriter *writer) {
     if (!writer->f)
         return false;
 
+    if (writer->pipeline)
+        GifPipelineFinish(writer);
+
     fputc(0x3b, writer->f); // end of file
     fclose(writer->f);
     GIF_FREE(writer->oldImage);
+    GIF_FREE(writer->lastImage);
 
     writer->f = NULL;
     writer->oldImage = NULL;
+    writer->lastImage = NULL;
 
     return true;
 }
@@ -118,6 +118,12 @@ void GifMakePalette(const uint8_t *lastFrame, const uint8_t *nextFrame,
 void GifDitherImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
         uint8_t *outFrame, uint32_t width, uint32_t height, GifPalette *pPal);
 
+// Implements ordered (8x8 Bayer matrix) dithering, writes palette value to alpha.
+// Each pixel only depends on its own color and position, so the per-row arithmetic is
+// written to auto-vectorize. Whole frames run in parallel through GifSetThreads.
+void GifOrderedDitherImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t width, uint32_t height, GifPalette *pPal);
+
 // Picks palette colors for the image using simple thresholding, no dithering
 void GifThresholdImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
         uint8_t *outFrame, uint32_t width, uint32_t height, GifPalette *pPal);
@@ -149,13 +155,97 @@ struct GifLzwNode {
 void GifWritePalette(const GifPalette *pPal, FILE *f);
 
 // write the image header, LZW-compress and write out the image
+// image points at the top-left pixel of the rectangle being written; stride is the
+// distance between its rows in pixels, 0 meaning the image is exactly width pixels wide
 void GifWriteLzwImage(FILE *f, uint8_t *image, uint32_t left, uint32_t top,
-        uint32_t width, uint32_t height, uint32_t delay, GifPalette *pPal);
+        uint32_t width, uint32_t height, uint32_t delay, GifPalette *pPal,
+        uint32_t stride = 0);
+
+// A rectangle in canvas space
+struct GifRect {
+    uint32_t left;
+    uint32_t top;
+    uint32_t width;
+    uint32_t height;
+};
+
+// Finds the bounding box of the pixels of a palettized frame that are not transparent,
+// i.e. the part of the canvas that the frame actually changes.
+// Returns false if the whole frame is transparent.
+bool GifFindChangedRect(const uint8_t *frame, uint32_t width, uint32_t height,
+        GifRect *rect);
+
+// Checks whether two frames have the same color at every pixel (alpha is ignored)
+bool GifSameFrame(const uint8_t *frameA, const uint8_t *frameB,
+        uint32_t numPixels);
+
+// The smallest palette bit depth with room for numColors colors besides the transparency
+// index. Never less than 2, the smallest LZW code size GIF allows.
+int GifSmallestBitDepth(int numColors);
+
+// Tries to palettize a frame without loss: collects the distinct colors of the pixels that
+// changed since lastFrame and, if there are few enough to fit a palette of maxBitDepth,
+// uses exactly those colors at the smallest bit depth that holds them.
+// Returns false, leaving outFrame untouched, if there are too many colors.
+bool GifExactPaletteImage(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t width, uint32_t height, int maxBitDepth,
+        GifPalette *pPal);
+
+// Expands an indexed frame to RGBA with the palette index in alpha.
+// Only the colors the frame actually uses go into the palette, renumbered from 1 up,
+// since index 0 is reserved for transparency. With smallestDepth the palette shrinks
+// to the smallest bit depth (up to bitDepth) that holds them.
+// Returns false (leaving just the RGB filled in) if the colors don't fit.
+bool GifExpandIndexedFrame(const uint8_t *indices, const uint32_t *colors,
+        int numColors, uint32_t numPixels, uint8_t *outFrame, int bitDepth,
+        bool smallestDepth, GifPalette *pPal);
+
+// Delta-encodes a frame that already has its palette index in alpha:
+// pixels with the same color as in lastFrame become transparent.
+void GifDeltaIndexedFrame(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t numPixels);
+
+// How frames are dithered when GifWriteFrame is asked to dither
+enum GifDitherMode {
+    kGifDitherFloydSteinberg, // error diffusion: the best looking, but inherently serial
+    kGifDitherOrdered         // Bayer matrix: close to thresholding speed and uses all cores
+};
+
+// How the palette size of each frame is picked
+enum GifDepthPreset {
+    kGifDepthFixed,   // always the bitDepth passed to GifWriteFrame
+    kGifDepthQuality, // if the changed pixels have few enough colors, exactly those colors at the
+                      // smallest bit depth that holds them; otherwise the bitDepth passed in
+    kGifDepthSpeed    // the same, but frames with too many colors get at most 6 bits, which
+                      // shrinks the k-d tree, the LZW codes and the file at some cost in quality
+};
+
+// Builds a palette for a frame and palettizes it into outFrame (palette index in alpha).
+// This is everything GifWriteFrame does before LZW compression, and it only depends on
+// the frame itself and the delta base lastFrame, so it can run on any thread.
+void GifQuantizeFrame(const uint8_t *lastFrame, const uint8_t *nextFrame,
+        uint8_t *outFrame, uint32_t width, uint32_t height, int bitDepth,
+        bool dither, GifPalette *pPal,
+        GifDitherMode ditherMode = kGifDitherFloydSteinberg,
+        GifDepthPreset depthPreset = kGifDepthFixed);
+
+// State of the multi-threaded encoder, see GifSetThreads
+struct GifPipeline;
 
 struct GifWriter {
     FILE *f;
     uint8_t *oldImage;
+    uint8_t *lastImage; // the previous input frame, to spot frames that change nothing
     bool firstFrame;
+
+    uint32_t width;
+    uint32_t height;
+    GifPipeline *pipeline; // NULL unless GifSetThreads has been called
+    GifDitherMode ditherMode;
+    GifDepthPreset depthPreset;
+
+    long lastDelayPos;  // file offset of the delay of the last frame written, -1 before the first one
+    uint32_t lastDelay; // delay of the last frame written, grows when identical frames are merged into it
 };
 
 // Creates a gif file.
@@ -169,9 +259,38 @@ bool GifBegin(GifWriter *writer, const char *filename, uint32_t width,
 // The GIFWriter should have been created by GIFBegin.
 // AFAIK, it is legal to use different bit depths for different frames of an image -
 // this may be handy to save bits in animations that don't change much.
+// Only the bounding box of the pixels that changed since the previous frame is compressed,
+// and a frame identical to the previous one just adds its delay to that frame.
 bool GifWriteFrame(GifWriter *writer, const uint8_t *image, uint32_t width,
         uint32_t height, uint32_t delay, int bitDepth = 8, bool dither = false);
 
+// Writes out a frame that is already palettized, given as one palette index per pixel
+// and its color table (0xAARRGGBB, alpha ignored, as in QImage::colorTable()).
+// Palette building and quantization are skipped, so the colors are written exactly.
+// Frames that use all 256 colors leave no room for the transparency index and go
+// through GifWriteFrame instead.
+bool GifWriteIndexedFrame(GifWriter *writer, const uint8_t *indices,
+        const uint32_t *colors, int numColors, uint32_t width, uint32_t height,
+        uint32_t delay);
+
+// Switches a GIF in progress to multi-threaded encoding.
+// Palette building and quantization run on numThreads worker threads (0 picks one per core),
+// while GifWriteFrame and GifEnd still LZW-compress and write the frames in order on the
+// calling thread. At most maxFramesInFlight frames are buffered, so GifWriteFrame blocks
+// when the workers fall that far behind.
+// Each frame is delta-encoded against the previous input frame instead of the previous
+// quantized frame, since that is the only thing that lets frames be processed independently.
+// Must be called after GifBegin and before the first GifWriteFrame.
+bool GifSetThreads(GifWriter *writer, int numThreads, int maxFramesInFlight);
+
+// Chooses how frames written with dither = true are dithered.
+// The default is Floyd-Steinberg; ordered dithering is much faster on large frames.
+bool GifSetDitherMode(GifWriter *writer, GifDitherMode mode);
+
+// Chooses how the palette size of each frame is picked, see GifDepthPreset.
+// The default is kGifDepthFixed, i.e. the bitDepth passed to each GifWriteFrame.
+bool GifSetDepthPreset(GifWriter *writer, GifDepthPreset preset);
+
 // Writes the EOF code, closes the file handle, and frees temp memory used by a GIF.
 // Many if not most viewers will still display a GIF properly if the EOF code is missing,
 // but it's still a good idea to write it out.
@@ -1,4 +1,10 @@
 #include "graph.h"
+#include <QWheelEvent>
+#include <QtMath>
+
+const qreal Graph::ZOOM_STEP = 1.25;
+
+const qreal Graph::MAX_ZOOM = 64.0;
 
 /*!
  * \brief construct a derived class for QGraphicsView.
@@ -11,6 +17,39 @@
 Graph::Graph(QWidget *parent) :
         QGraphicsView(parent) {
     setInteractive(true);
+    setDragMode(QGraphicsView::ScrollHandDrag);
+    setTransformationAnchor(QGraphicsView::AnchorUnderMouse);
+    setRenderHint(QPainter::SmoothPixmapTransform);
+    connect(this, &QGraphicsView::rubberBandChanged, this, &Graph::rubberBandChange);
+}
+
+/*!
+ * \brief Switch dragging between panning and selecting rectangles.
+ *
+ * \param selecting true to select rectangles by dragging, false to pan
+ */
+
+void Graph::setSelecting(bool selecting) {
+    setDragMode(selecting ? QGraphicsView::RubberBandDrag : QGraphicsView::ScrollHandDrag);
+}
+
+/*!
+ * \brief Follow the rubber band while the user drags it, and emit regionSelected when it is released.
+ *
+ * \param rubberBandRect The rubber band in viewport coordinates, null once it is released
+ * \param fromScenePoint The point where the drag started, in scene coordinates
+ * \param toScenePoint The current point of the drag, in scene coordinates
+ */
+
+void Graph::rubberBandChange(QRect rubberBandRect, QPointF fromScenePoint, QPointF toScenePoint) {
+    if (!rubberBandRect.isNull()) {
+        selection = QRectF(fromScenePoint, toScenePoint).normalized();
+        return;
+    }
+    if (!selection.isEmpty()) {
+        emit regionSelected(selection);
+    }
+    selection = QRectF();
 }
 
 /*!
@@ -25,4 +64,39 @@ void Graph::resizeEvent(QResizeEvent *event) {
 //    fitInView(scene()->sceneRect(), Qt::KeepAspectRatio);
     emit sizechange();
     QGraphicsView::resizeEvent(event);
+    emit viewportChanged();
+}
+
+/*!
+ * \brief Override the wheelEvent of class QGraphicsView to zoom in and out around the mouse.
+ *
+ * The zoom is kept between the image fitting the view and MAX_ZOOM times that, \
+ * the tiled foreground picks the matching resolution when it is repainted.
+ *
+ * \param event this is the QWheelEvent defined by QT
+ */
+
+void Graph::wheelEvent(QWheelEvent *event) {
+    int steps = event->angleDelta().y() / 120;
+    if (steps == 0) {
+        event->ignore();
+        return;
+    }
+    qreal current = transform().m11();
+    qreal target = qBound(1.0, current * qPow(ZOOM_STEP, steps), MAX_ZOOM);
+    scale(target / current, target / current);
+    event->accept();
+    emit viewportChanged();
+}
+
+/*!
+ * \brief Override the scrollContentsBy of class QGraphicsView to tell others the view has been panned.
+ *
+ * \param dx The horizontal distance scrolled
+ * \param dy The vertical distance scrolled
+ */
+
+void Graph::scrollContentsBy(int dx, int dy) {
+    QGraphicsView::scrollContentsBy(dx, dy);
+    emit viewportChanged();
 }
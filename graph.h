@@ -6,18 +6,32 @@
 #include <QGraphicsView>
 
 /*!
- * \brief A derived class of QGraphicsView that supports resizing when dragged by user.
+ * \brief A derived class of QGraphicsView that supports resizing when dragged by user, zooming with the wheel and panning by dragging.
  */
 class Graph: public QGraphicsView {
     Q_OBJECT
 
 public:
     Graph(QWidget *parent = nullptr);
+    void setSelecting(bool);
 
 protected:
-    virtual void resizeEvent(QResizeEvent*) override;signals:
+    virtual void resizeEvent(QResizeEvent*) override;
+    virtual void wheelEvent(QWheelEvent*) override;
+    virtual void scrollContentsBy(int, int) override;
+private:
+    static const qreal ZOOM_STEP; /*!< The factor the view is scaled by for one notch of the wheel */
+    static const qreal MAX_ZOOM; /*!< The largest zoom, relative to the image fitting the view */
+    QRectF selection; /*!< The rectangle being dragged, in scene coordinates */
+private slots:
+    void rubberBandChange(QRect, QPointF, QPointF);
+signals:
     void sizechange();
     /*!<  Emit this signal when changing the size of Graph window */
+    void viewportChanged();
+    /*!<  Emit this signal when the visible part of the scene changes by resizing, zooming or panning */
+    void regionSelected(const QRectF &rect);
+    /*!<  Emit this signal with the rectangle in scene coordinates when the user finishes dragging one while selecting */
 };
 
 #endif // GRAPH_H
@@ -1,4 +1,6 @@
 #include "graphicscene.h"
+#include "imageio.h"
+#include <QtConcurrent>
 
 //const QString GraphicsScene::DEFAULT_PHOTO = ":";
 
@@ -6,46 +8,171 @@ const double GraphicsScene::BACKGROUND_Z_VALUE = -2000.0;
 
 const double GraphicsScene::FOREGROUND_Z_VALUE = -1000.0;
 
+const int GraphicsScene::RESIZE_DELAY = 100;
+
 /*!
  * \brief set the origional image into Graph's data member and process it to fill the scene.
  *
- * process the background image using the origional image and then process the foreground image using the origional image, add both into the scene
+ * build the mip pyramid of the image once, then process the background image from the nearest level of the pyramid, \
+ * and hand the pyramid to the tiled foreground item which only draws what is visible.
  *
  * \param img The image being processed and showed
  */
 void GraphicsScene::setImage(const QImage &img) {
     if (img.isNull())
         return;
+    loading = false; // an image set directly replaces one being loaded
     image = img;
     hasImage = true;
+    clearSelections();
+    pyramid.setImage(image);
+    generation++; // anything still being rendered is for the previous image
+
+    if (!foreground) {
+        foreground = new TiledImageItem();
+        foreground->setZValue(FOREGROUND_Z_VALUE);
+        this->addItem(foreground);
+    }
+    foreground->setPyramid(&pyramid);
+    fitForeground();
 
-    QImage enlargedImage = image.scaled(view->width(), view->height(),
+    QSize viewSize(view->width(), view->height());
+    showRendering(render(levelForView(viewSize), viewSize, generation));
+}
+;
+
+/*!
+ * \brief read an image file on worker threads, showing a preview first.
+ *
+ * A preview scaled down to the view by the decoder and the full-resolution image are read at the same time. \
+ * The preview is shown as soon as it arrives, unless the full image arrived first, and is replaced by it. \
+ * Until then the image cannot be selected on, and getImage() waits for the full image.
+ *
+ * \param path The image file
+ */
+void GraphicsScene::load(const QString &path) {
+    loading = true;
+    generation++; // anything still being rendered is for the previous image
+    previewWatcher.setFuture(QtConcurrent::run(&imageio::preview, path, QSize(view->width(), view->height())));
+    loadWatcher.setFuture(QtConcurrent::run(&imageio::read, path));
+}
+
+/*!
+ * \brief check if the image given to load() is still being read.
+ *
+ * \return Whether the full image has not arrived yet
+ */
+bool GraphicsScene::isLoading() const {
+    return loading;
+}
+
+/*!
+ * \brief show a preview of the image being loaded, in the background and the foreground.
+ *
+ * \param preview The image scaled down to the view
+ */
+void GraphicsScene::showPreview(const QImage &preview) {
+    image = preview;
+    pyramid.setImage(image);
+    if (!foreground) {
+        foreground = new TiledImageItem();
+        foreground->setZValue(FOREGROUND_Z_VALUE);
+        this->addItem(foreground);
+    }
+    foreground->setPyramid(&pyramid);
+    fitForeground();
+
+    QSize viewSize(view->width(), view->height());
+    showRendering(render(image, viewSize, generation));
+}
+
+/*!
+ * \brief show the preview once it has been read, if the full image is still being read.
+ */
+void GraphicsScene::previewFinished() {
+    QImage preview = previewWatcher.result();
+    if (loading && !preview.isNull())
+        showPreview(preview);
+}
+
+/*!
+ * \brief show the full image once it has been read, or tell that it could not be.
+ */
+void GraphicsScene::loadFinished() {
+    if (!loading)
+        return; // setImage() was called in the meantime
+    QImage full = loadWatcher.result();
+    loading = false;
+    if (full.isNull()) {
+        emit loadFailed();
+        return;
+    }
+    setImage(full);
+}
+
+/*!
+ * \brief scale an image to fill a view.
+ *
+ * This only reads its arguments, so it can run on a worker thread.
+ *
+ * \param source The level of the pyramid to scale from
+ * \param viewSize The size of the view
+ * \param generation The generation of the image the source belongs to
+ * \return The background image for that view size
+ */
+GraphicsScene::Rendering GraphicsScene::render(const QImage &source, QSize viewSize, int generation) {
+    Rendering rendering;
+    rendering.viewSize = viewSize;
+    rendering.generation = generation;
+
+    QImage enlargedImage = source.scaled(viewSize,
             Qt::KeepAspectRatioByExpanding, Qt::SmoothTransformation);
-    QImage choppedImage = enlargedImage.copy(0, 0, view->width(),
-            view->height());
-    // Foreground unprocessed image
-    QImage scaledImage = image.scaled(view->width(), view->height(),
-            Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    rendering.background = enlargedImage.copy(0, 0, viewSize.width(),
+            viewSize.height());
+    return rendering;
+}
+
+/*!
+ * \brief pick the smallest level of the pyramid that still fills a view without being enlarged.
+ *
+ * \param viewSize The size of the view
+ * \return The level to scale from
+ */
+QImage GraphicsScene::levelForView(QSize viewSize) const {
+    qreal scale = qMax(viewSize.width() / static_cast<qreal>(image.width()),
+            viewSize.height() / static_cast<qreal>(image.height()));
+    return pyramid.level(pyramid.levelFor(scale));
+}
 
+/*!
+ * \brief replace the background pixmap with a rendering.
+ *
+ * \param rendering The image to be shown
+ */
+void GraphicsScene::showRendering(const Rendering &rendering) {
     if (background) {
         this->removeItem(background);
         delete background;
     }
-    background = this->addPixmap(QPixmap::fromImage(choppedImage));
+    background = this->addPixmap(QPixmap::fromImage(rendering.background));
     background->setTransformationMode(Qt::SmoothTransformation);
     background->setZValue(BACKGROUND_Z_VALUE);
+}
 
-    if (foreground) {
-        this->removeItem(foreground);
-        delete foreground;
-    }
-    foreground = this->addPixmap(QPixmap::fromImage(scaledImage));
-    foreground->setPos(view->width() / 2.0 - scaledImage.width() / 2.0 - 1,
-            view->height() / 2.0 - scaledImage.height() / 2.0 - 1);
-    foreground->setTransformationMode(Qt::SmoothTransformation);
-    background->setZValue(FOREGROUND_Z_VALUE);
+/*!
+ * \brief scale the foreground item to fit inside the view and center it.
+ *
+ * This only changes the item's transform, the tiles are drawn at the new size when they are painted.
+ */
+void GraphicsScene::fitForeground() {
+    if (!foreground)
+        return;
+    qreal scale = qMin(view->width() / static_cast<qreal>(image.width()),
+            view->height() / static_cast<qreal>(image.height()));
+    foreground->setScale(scale);
+    foreground->setPos(view->width() / 2.0 - image.width() * scale / 2.0 - 1,
+            view->height() / 2.0 - image.height() * scale / 2.0 - 1);
 }
-;
 
 /*!
  * \brief return the origional image in the scene.
@@ -56,14 +183,70 @@ void GraphicsScene::setImage(const QImage &img) {
  */
 
 QImage GraphicsScene::getImage() const {
+    if (loading)
+        return loadWatcher.future().result(); // asked for before the full image arrived, so wait for it
     return image;
 }
 
+/*!
+ * \brief find the part of the image currently visible in the view.
+ *
+ * \return The visible area in pixels of the image, empty if there is no image
+ */
+QRect GraphicsScene::visibleRect() const {
+    if (!hasImage)
+        return QRect();
+    QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+    return foreground->mapFromScene(visible).boundingRect().toAlignedRect().intersected(image.rect());
+}
+
+/*!
+ * \brief An accessor for the regions selected by the user.
+ *
+ * \return The regions in pixels of the image
+ */
+QVector<QRect> GraphicsScene::selectedRegions() const {
+    return selections;
+}
+
+/*!
+ * \brief forget the selected regions and remove their outlines.
+ */
+void GraphicsScene::clearSelections() {
+    qDeleteAll(selectionItems);
+    selectionItems.clear();
+    selections.clear();
+}
+
+/*!
+ * \brief this is the slot to accept a rectangle selected in the view, and outline it on the image.
+ *
+ * \param rect The rectangle in scene coordinates
+ */
+void GraphicsScene::addSelection(const QRectF &rect) {
+    if (!hasImage)
+        return;
+    QRect area = foreground->mapFromScene(rect).boundingRect().toAlignedRect().intersected(image.rect());
+    if (area.isEmpty())
+        return;
+    selections.append(area);
+    QGraphicsRectItem *outline = new QGraphicsRectItem(QRectF(area), foreground);
+    QPen pen(Qt::red, 2);
+    pen.setCosmetic(true); // keep the outline 2 pixels wide however the image is scaled
+    outline->setPen(pen);
+    outline->setBrush(QColor(255, 0, 0, 48));
+    selectionItems.append(outline);
+}
+
 /*!
  * \brief destructor: delete all the pointers in the class.
  *
+ * A rendering or a load still running in the background is waited for first.
  */
 GraphicsScene::~GraphicsScene() {
+    renderWatcher.waitForFinished();
+    previewWatcher.waitForFinished();
+    loadWatcher.waitForFinished();
     delete background;
     delete foreground;
     delete view;
@@ -81,14 +264,77 @@ GraphicsScene::~GraphicsScene() {
 GraphicsScene::GraphicsScene(Graph *view, QObject *parent) :
         QGraphicsScene(parent), background(nullptr), foreground(nullptr), view(
                 view) {
+    resizeTimer.setSingleShot(true);
+    resizeTimer.setInterval(RESIZE_DELAY);
     connect(view, &Graph::sizechange, this, &GraphicsScene::sizeChange);
+    connect(view, &Graph::regionSelected, this, &GraphicsScene::addSelection);
+    connect(&resizeTimer, &QTimer::timeout, this, &GraphicsScene::startRendering);
+    connect(&renderWatcher, &QFutureWatcher<Rendering>::finished, this, &GraphicsScene::renderingFinished);
+    connect(&previewWatcher, &QFutureWatcher<QImage>::finished, this, &GraphicsScene::previewFinished);
+    connect(&loadWatcher, &QFutureWatcher<QImage>::finished, this, &GraphicsScene::loadFinished);
 }
 
 /*!
  * \brief this is the slot to accept the sizechange signal, reset the scene to fit the GraphicsView.
+ *
+ * The foreground follows the new size right away. Rescaling the background only starts once the view \
+ * has kept the same size for RESIZE_DELAY milliseconds, so dragging a window edge does not rescale the \
+ * image for every intermediate size.
  */
 
 void GraphicsScene::sizeChange() {
-    setImage (image);
+    fitForeground();
+    resizeTimer.start();
     view->setScene(this);
 }
+
+/*!
+ * \brief this is the slot to accept part of the image that has changed, e.g. a tile finished by a filter.
+ *
+ * Only the matching part of the pyramid is rebuilt and only the tiles showing it are redrawn. \
+ * The background is rescaled once the updates have stopped for RESIZE_DELAY milliseconds.
+ *
+ * \param rect The changed area of the image
+ * \param tile The new pixels of that area
+ */
+void GraphicsScene::updateRegion(const QRect &rect, const QImage &tile) {
+    if (!hasImage)
+        return;
+    image = QImage(); // let the pyramid be updated in place instead of copied
+    pyramid.updateRegion(rect, tile);
+    image = pyramid.level(0);
+    foreground->invalidate(rect);
+    resizeTimer.start();
+}
+
+/*!
+ * \brief rescale the image for the current view size on a worker thread.
+ *
+ * If a rescale is already running, another one is started as soon as it finishes.
+ */
+void GraphicsScene::startRendering() {
+    if (!hasImage)
+        return;
+    if (renderWatcher.isRunning()) {
+        renderPending = true;
+        return;
+    }
+    QSize viewSize(view->width(), view->height());
+    renderWatcher.setFuture(QtConcurrent::run(&GraphicsScene::render,
+            levelForView(viewSize), viewSize, generation));
+}
+
+/*!
+ * \brief show a finished rescale, unless the image or the view size has changed since it started.
+ */
+void GraphicsScene::renderingFinished() {
+    Rendering rendering = renderWatcher.result();
+    if (rendering.generation == generation
+            && rendering.viewSize == QSize(view->width(), view->height())) {
+        showRendering(rendering);
+    }
+    if (renderPending) {
+        renderPending = false;
+        startRendering();
+    }
+}
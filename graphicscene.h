@@ -11,7 +11,11 @@
 #include <QPainterPath>
 #include <QGraphicsPathItem>
 #include <QGraphicsView>
+#include <QTimer>
+#include <QFutureWatcher>
 #include "graph.h"
+#include "imagepyramid.h"
+#include "tiledimageitem.h"
 
 /*!
  * \brief A class used to display a background pixmap and a foreground pixmap based on the image that it contains.
@@ -24,20 +28,60 @@ public:
     GraphicsScene(Graph* view,QObject *parent = nullptr);
     ~GraphicsScene();
     void setImage(const QImage &img);
+    void load(const QString&);
+    bool isLoading() const;
     QImage getImage() const;
+    QRect visibleRect() const;
+    QVector<QRect> selectedRegions() const;
+    void clearSelections();
 
 private:
+    /*!
+     * \brief The background image shown for one view size, ready to be turned into a pixmap.
+     */
+    struct Rendering {
+        QSize viewSize; /*!< The view size the image was made for */
+        int generation; /*!< The value of generation when the rendering was started */
+        QImage background; /*!< The image filling the whole view */
+    };
+    static Rendering render(const QImage&, QSize, int);
+    QImage levelForView(QSize) const;
+    void showRendering(const Rendering&);
+    void fitForeground();
+    void showPreview(const QImage&);
+    static const int RESIZE_DELAY; /*!< How long in milliseconds the view size must stay the same before rescaling */
     static const double BACKGROUND_Z_VALUE; /*!< The background Z-value, greater Z-value result in a pixmap shows above another one */
     static const double FOREGROUND_Z_VALUE; /*!< The foreground Z-value, greater Z-value result in a pixmap shows above another one */
     static const QString DEFAULT_PHOTO;    /*!< The default photo when no image is uploaded */
     QImage image; /*!< The image being processed for the scene */
     QGraphicsPixmapItem *background;  /*!< The background pixmap get from the original image after a series of process */
-    QGraphicsPixmapItem *foreground;  /*!< The foreground pixmap get from the original image after a series of process */
+    TiledImageItem *foreground;  /*!< The foreground image, drawn tile by tile at the resolution the view needs */
     Graph* view;     /*!< The Graph paired with this GraphicsScene*/
     bool hasImage = false;  /*!< Determine if this GraphicsScene has an image*/
+    ImagePyramid pyramid; /*!< Downscaled copies of the image, so that rescaling starts from the nearest size */
+    QTimer resizeTimer; /*!< Restarted by every resize, so that rescaling waits until resizing stops */
+    QFutureWatcher<Rendering> renderWatcher; /*!< Watches the rescaling running in the background */
+    QFutureWatcher<QImage> previewWatcher; /*!< Watches the reading of the preview of the image being loaded */
+    QFutureWatcher<QImage> loadWatcher; /*!< Watches the reading of the full image being loaded */
+    bool loading = false; /*!< The full image is still being read, only its preview may be shown */
+    int generation = 0; /*!< Increased with every new image, so that renderings of an old image are dropped */
+    bool renderPending = false; /*!< The view was resized again while a rendering was running */
+    QVector<QRect> selections; /*!< The regions selected by the user, in pixels of the image */
+    QVector<QGraphicsRectItem*> selectionItems; /*!< The outlines of the selected regions, children of the foreground */
 
 public slots:
     void sizeChange();
+    void updateRegion(const QRect&, const QImage&);
+    void addSelection(const QRectF&);
+
+signals:
+    void loadFailed(); /*!< A signal telling that the image given to load() could not be read */
+
+private slots:
+    void startRendering();
+    void renderingFinished();
+    void previewFinished();
+    void loadFinished();
 
 };
 
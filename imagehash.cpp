@@ -0,0 +1,64 @@
+#include "imagehash.h"
+#include <cstring>
+
+const quint64 imagehash::MULTIPLIER = Q_UINT64_C(0x9E3779B97F4A7C15);
+
+/*!
+ * \brief Hash a block of memory eight bytes at a time.
+ * \param data The memory
+ * \param length The number of bytes
+ * \param seed The hash to continue from, e.g. the hash of what came before
+ * \return The hash
+ */
+quint64 imagehash::bytes(const void *data, qint64 length, quint64 seed) {
+    const uchar *p = static_cast<const uchar*>(data);
+    quint64 h = seed ^ (static_cast<quint64>(length) * MULTIPLIER);
+    qint64 i = 0;
+    for (; i + 8 <= length; i += 8) {
+        quint64 word;
+        memcpy(&word, p + i, 8); // the scanlines are not necessarily 8-byte aligned
+        h = (h ^ word) * MULTIPLIER;
+        h ^= h >> 32;
+    }
+    for (; i < length; i++) {
+        h = (h ^ p[i]) * MULTIPLIER;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+/*!
+ * \brief Hash the size, format and pixels of an image.
+ *
+ * Only the bytes holding pixels are read, so padding at the end of the scanlines does not change the hash.
+ *
+ * \param img The image
+ * \param seed The hash to continue from
+ * \return The hash, the same for images with the same size, format and pixels
+ */
+quint64 imagehash::image(const QImage &img, quint64 seed) {
+    quint64 h = combine(seed, static_cast<quint64>(img.width()));
+    h = combine(h, static_cast<quint64>(img.height()));
+    h = combine(h, static_cast<quint64>(img.format()));
+    qint64 lineBytes = (static_cast<qint64>(img.width()) * img.depth() + 7) / 8;
+    for (int i = 0; i < img.height(); i++) {
+        h = bytes(img.constScanLine(i), lineBytes, h);
+    }
+    if (img.format() == QImage::Format_Indexed8 || img.format() == QImage::Format_Mono
+            || img.format() == QImage::Format_MonoLSB) {
+        QVector<QRgb> colors = img.colorTable();
+        h = bytes(colors.constData(), colors.size() * static_cast<qint64>(sizeof(QRgb)), h);
+    }
+    return h;
+}
+
+/*!
+ * \brief Mix two hashes, or a hash and a number, into one.
+ * \param a The first hash
+ * \param b The second hash
+ * \return The combined hash, which depends on the order of a and b
+ */
+quint64 imagehash::combine(quint64 a, quint64 b) {
+    quint64 h = (a ^ (b + MULTIPLIER + (a << 6) + (a >> 2))) * MULTIPLIER;
+    return h ^ (h >> 32);
+}
@@ -0,0 +1,20 @@
+#ifndef IMAGEHASH_H
+#define IMAGEHASH_H
+
+#include <QImage>
+#include <QtGlobal>
+
+/*!
+ * \brief A class containing fast non-cryptographic hashes of images, used to recognise the same inputs again.
+ */
+class imagehash {
+public:
+    imagehash() = delete;
+    static quint64 bytes(const void *data, qint64 length, quint64 seed = 0);
+    static quint64 image(const QImage &img, quint64 seed = 0);
+    static quint64 combine(quint64 a, quint64 b);
+private:
+    static const quint64 MULTIPLIER; /*!< An odd constant with well-mixed bits used to scramble every word */
+};
+
+#endif // IMAGEHASH_H
@@ -0,0 +1,175 @@
+#include "imageio.h"
+#include "qoicodec.h"
+#include "rawimage.h"
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QImageWriter>
+#include <QSaveFile>
+#include <QSettings>
+
+const int imageio::FAST_QUALITY = 89;
+
+const int imageio::SMALL_QUALITY = 0;
+
+/*!
+ * \brief Read the start of a file, enough to recognise a QOI header.
+ * \param path The file
+ * \return The first bytes, fewer if the file is shorter or cannot be read
+ */
+QByteArray imageio::header(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+    return file.read(qoicodec::HEADER_SIZE);
+}
+
+/*!
+ * \brief Read an image at full resolution. QOI, PGM, PPM and PAM files are recognised by their header, whatever their extension.
+ *
+ * PGM, PPM and PAM files with 8-bit samples are mapped rather than read; others, e.g. with 16-bit samples, are left to Qt.
+ *
+ * \param path The file
+ * \return The image, or a null image if it cannot be read
+ */
+QImage imageio::read(const QString &path) {
+    QByteArray start = header(path);
+    if (qoicodec::canDecode(start)) {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QImage();
+        }
+        return qoicodec::decode(file.readAll());
+    }
+    if (rawimage::canRead(start)) {
+        QImage image = rawimage::read(path);
+        if (!image.isNull()) {
+            return image;
+        }
+    }
+    QImageReader reader(path);
+    return reader.read();
+}
+
+/*!
+ * \brief Read an image scaled down to just cover a view, for showing it while the full image is read.
+ *
+ * The scaling is done by the decoder, so formats that support it (e.g. JPEG) skip most of the work \
+ * of a full read. The image is never scaled up. QOI, PGM, PPM and PAM files get no preview, reading them \
+ * in full is fast enough.
+ *
+ * \param path The file
+ * \param bound The size of the view the preview must cover
+ * \return The preview, or a null image if the size of the image cannot be read without decoding it
+ */
+QImage imageio::preview(const QString &path, const QSize &bound) {
+    QByteArray start = header(path);
+    if (qoicodec::canDecode(start) || rawimage::canRead(start)) {
+        return QImage();
+    }
+    QImageReader reader(path);
+    QSize full = reader.size();
+    if (!full.isValid() || bound.isEmpty()) {
+        return QImage();
+    }
+    QSize scaled = full.scaled(bound, Qt::KeepAspectRatioByExpanding);
+    if (scaled.width() < full.width()) {
+        reader.setScaledSize(scaled);
+    }
+    return reader.read();
+}
+
+/*!
+ * \brief Read the size of an image from its header, without decoding it.
+ * \param path The file
+ * \return The size, or an invalid size if it cannot be read
+ */
+QSize imageio::size(const QString &path) {
+    QByteArray start = header(path);
+    if (qoicodec::canDecode(start)) {
+        return qoicodec::size(start);
+    }
+    if (rawimage::canRead(start)) {
+        QSize size = rawimage::size(path);
+        if (size.isValid()) {
+            return size;
+        }
+    }
+    return QImageReader(path).size();
+}
+
+/*!
+ * \brief The extension intermediate images are written with: blurred images, residues and cipher images.
+ *
+ * PNG unless the setting "files/intermediate" is "qoi", which is written and read several times faster, \
+ * or "pam" or "planar", which are not compressed at all and are mapped rather than read.
+ *
+ * \return "png", "qoi", "pam" or "planar"
+ */
+QString imageio::intermediateFormat() {
+    QString format = QSettings().value("files/intermediate").toString();
+    return format == "qoi" || format == "pam" || format == "planar" ? format : "png";
+}
+
+/*!
+ * \brief Find an image written in any of the formats intermediate images may be in.
+ *
+ * Blurring again into the same folder in another format leaves the older files there, so the most recently \
+ * written one is taken, the same way for every stem.
+ *
+ * \param stem The file without its extension, e.g. "folder/red"
+ * \return The newest of the PNG, QOI, PAM and planar files, or the PNG file if there is none, whether it exists or not
+ */
+QString imageio::find(const QString &stem) {
+    QString newest = stem + ".png";
+    QDateTime newestTime = QFileInfo(newest).lastModified(); // invalid if there is no PNG file
+    for (const QString &suffix : {".qoi", ".pam", ".planar"}) {
+        QFileInfo info(stem + suffix);
+        if (info.exists() && (!newestTime.isValid() || info.lastModified() > newestTime)) {
+            newest = info.filePath();
+            newestTime = info.lastModified();
+        }
+    }
+    return newest;
+}
+
+/*!
+ * \brief Write an image, in the format given by the extension of the file.
+ *
+ * For PNG files, Qt turns the quality into the zlib level as (100 - quality) * 9 / 91, so FAST_QUALITY \
+ * gives level 1 and SMALL_QUALITY level 9. Files ending in .qoi are written with qoicodec, and files ending \
+ * in .pgm, .ppm, .pam or .planar by rawimage. Other formats ignore the compression.
+ *
+ * \param image The image
+ * \param path The file
+ * \param compression How hard to compress it
+ * \return Whether the image was written
+ */
+bool imageio::write(const QImage &image, const QString &path, Compression compression) {
+    if (path.endsWith(".qoi", Qt::CaseInsensitive)) {
+        QByteArray data = qoicodec::encode(image);
+        QSaveFile file(path);
+        return !data.isEmpty() && file.open(QIODevice::WriteOnly) && file.write(data) == data.size() && file.commit();
+    }
+    if (rawimage::canWrite(path)) {
+        return rawimage::write(image, path);
+    }
+    QImageWriter writer(path);
+    if (compression == Fast) {
+        writer.setQuality(FAST_QUALITY);
+    } else if (compression == Small) {
+        writer.setQuality(SMALL_QUALITY);
+    }
+    return writer.write(image);
+}
+
+/*!
+ * \brief Write one of several images being written at once.
+ * \param output The image, its file and its compression
+ * \return Whether the image was written
+ */
+bool imageio::writeOutput(const Output &output) {
+    return write(output.image, output.path, output.compression);
+}
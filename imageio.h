@@ -0,0 +1,51 @@
+#ifndef IMAGEIO_H
+#define IMAGEIO_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/*!
+ * \brief A class reading and writing the images the filters work on.
+ *
+ * Images are read at full resolution or as a quick preview, and written with a compression preset chosen \
+ * for what they hold. Besides the formats of Qt, QOI files are read and written with qoicodec, and binary \
+ * PGM, PPM and PAM files, and planar PAM files, are read and written by memory-mapping them with rawimage. \
+ * Everything only reads its arguments, so it can run on worker threads.
+ */
+class imageio {
+public:
+    imageio() = delete;
+
+    /*!
+     * \brief How hard PNG files are compressed, trading the time to write them against their size.
+     */
+    enum Compression {
+        Fast, /*!< zlib level 1, for residues and other noise-like images that barely compress anyway */
+        Balanced, /*!< The zlib default, for photos */
+        Small /*!< zlib level 9, for images written once and kept long */
+    };
+
+    /*!
+     * \brief One image to write, so that several can be written at once with QtConcurrent::mapped().
+     */
+    struct Output {
+        QImage image; /*!< The image */
+        QString path; /*!< The file to write it to */
+        Compression compression; /*!< How hard to compress it */
+    };
+    static QImage read(const QString&);
+    static QImage preview(const QString&, const QSize&);
+    static QSize size(const QString&);
+    static bool write(const QImage&, const QString&, Compression = Balanced);
+    static bool writeOutput(const Output&);
+    static QString intermediateFormat();
+    static QString find(const QString&);
+private:
+    static QByteArray header(const QString&);
+    static const int FAST_QUALITY; /*!< The PNG quality of Fast */
+    static const int SMALL_QUALITY; /*!< The PNG quality of Small */
+};
+
+#endif // IMAGEIO_H
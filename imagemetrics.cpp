@@ -0,0 +1,68 @@
+#include "imagemetrics.h"
+#include <QtMath>
+#include <limits>
+
+/*!
+ * \brief Compare an image with a reference.
+ *
+ * Both images are read as RGB32, where the alpha byte is always 0xFF, so the scanlines can be compared \
+ * byte by byte without skipping the alpha channel. The inner loops have no branches and only add up \
+ * integers, so the compiler turns them into vector instructions.
+ *
+ * \param img The image
+ * \param reference The image it should be
+ * \return The comparison, the worst possible one if the sizes differ
+ */
+imagemetrics::Comparison imagemetrics::compare(const QImage &img, const QImage &reference) {
+    Comparison result;
+    if (img.size() != reference.size() || img.isNull()) {
+        return result;
+    }
+    QImage a = img.convertToFormat(QImage::Format_RGB32);
+    QImage b = reference.convertToFormat(QImage::Format_RGB32);
+    int h = a.height();
+    int w = a.width();
+
+    quint64 squares = 0;
+    qint64 matches = 0;
+    int largest = 0;
+    for (int i = 0; i < h; i++) {
+        const uchar *p = a.constScanLine(i);
+        const uchar *q = b.constScanLine(i);
+        for (int k = 0; k < w * 4; k++) {
+            int d = p[k] - q[k];
+            squares += static_cast<quint64>(d * d);
+            largest = qMax(largest, qAbs(d));
+        }
+        const quint32 *u = reinterpret_cast<const quint32*>(p);
+        const quint32 *v = reinterpret_cast<const quint32*>(q);
+        for (int j = 0; j < w; j++) {
+            matches += u[j] == v[j];
+        }
+    }
+
+    double mse = static_cast<double>(squares) / (static_cast<double>(w) * h * 3);
+    result.psnr = mse == 0 ? std::numeric_limits<double>::infinity() : 10 * std::log10(255.0 * 255.0 / mse);
+    result.exact = static_cast<double>(matches) / (static_cast<double>(w) * h);
+    result.maxError = largest;
+    return result;
+}
+
+/*!
+ * \brief Keep only the most significant bits of every channel, e.g. to get what a lossy filter should give back exactly.
+ * \param img The image
+ * \param bits How many bits of each channel to keep
+ * \return The image with the other bits cleared, as RGB32
+ */
+QImage imagemetrics::quantize(const QImage &img, int bits) {
+    QImage result = img.convertToFormat(QImage::Format_RGB32);
+    quint32 mask = (0xFFu << (8 - bits)) & 0xFFu;
+    mask = 0xFF000000u | mask << 16 | mask << 8 | mask;
+    for (int i = 0; i < result.height(); i++) {
+        quint32 *line = reinterpret_cast<quint32*>(result.scanLine(i));
+        for (int j = 0; j < result.width(); j++) {
+            line[j] &= mask;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,25 @@
+#ifndef IMAGEMETRICS_H
+#define IMAGEMETRICS_H
+
+#include <QImage>
+
+/*!
+ * \brief A class containing measures of how far an image is from a reference image.
+ */
+class imagemetrics {
+public:
+    imagemetrics() = delete;
+
+    /*!
+     * \brief How far an image is from a reference, over the red, green and blue channels.
+     */
+    struct Comparison {
+        double psnr = 0; /*!< The peak signal-to-noise ratio in decibels, infinite if the images are the same */
+        double exact = 0; /*!< The share of pixels with exactly the same color */
+        int maxError = 255; /*!< The largest difference of any channel of any pixel */
+    };
+    static Comparison compare(const QImage&, const QImage&);
+    static QImage quantize(const QImage&, int);
+};
+
+#endif // IMAGEMETRICS_H
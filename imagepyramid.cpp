@@ -0,0 +1,107 @@
+#include "imagepyramid.h"
+#include <QtMath>
+#include <QPainter>
+
+const int ImagePyramid::SMALLEST_LEVEL = 64;
+
+/*!
+ * \brief Build the pyramid of an image.
+ *
+ * Every level is scaled down from the previous one rather than from the original,
+ * so building the whole pyramid costs about as much as one full-resolution rescale.
+ *
+ * \param img The full-resolution image
+ */
+void ImagePyramid::setImage(const QImage &img) {
+    levels.clear();
+    if (img.isNull()) {
+        return;
+    }
+    levels.append(img);
+    while (levels.last().width() > SMALLEST_LEVEL || levels.last().height() > SMALLEST_LEVEL) {
+        const QImage &previous = levels.last();
+        if (previous.width() < 2 || previous.height() < 2) {
+            break;
+        }
+        levels.append(previous.scaled(previous.width() / 2, previous.height() / 2,
+                Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+    }
+}
+
+/*!
+ * \brief Replace part of the full-resolution image and rebuild only the matching part of every smaller level.
+ *
+ * Nothing else should share the levels while they are updated, or every update copies them whole.
+ *
+ * \param rect The area to replace, in full-resolution pixels
+ * \param tile The new pixels of that area
+ */
+void ImagePyramid::updateRegion(const QRect &rect, const QImage &tile) {
+    if (levels.isEmpty()) {
+        return;
+    }
+    QRect area = rect.intersected(levels.first().rect());
+    if (area.isEmpty()) {
+        return;
+    }
+    QPainter painter(&levels[0]);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(area.topLeft(), tile, area.translated(-rect.topLeft()));
+    painter.end();
+
+    for (int i = 1; i < levels.size(); i++) {
+        // The pixels of this level covering the changed area of the previous one, rounded outwards
+        area = QRect(QPoint(area.left() / 2, area.top() / 2),
+                QPoint(area.right() / 2, area.bottom() / 2)).intersected(levels[i].rect());
+        QRect source = QRect(area.left() * 2, area.top() * 2, area.width() * 2, area.height() * 2)
+                .intersected(levels[i - 1].rect());
+        QImage scaled = levels[i - 1].copy(source).scaled(area.size(),
+                Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        painter.begin(&levels[i]);
+        painter.setCompositionMode(QPainter::CompositionMode_Source);
+        painter.drawImage(area.topLeft(), scaled);
+        painter.end();
+    }
+}
+
+/*!
+ * \brief Check if the pyramid has been built from an image.
+ * \return Whether the pyramid is empty
+ */
+bool ImagePyramid::isNull() const {
+    return levels.isEmpty();
+}
+
+/*!
+ * \brief An accessor for the number of levels.
+ * \return The number of levels, 0 if there is no image
+ */
+int ImagePyramid::levelCount() const {
+    return levels.size();
+}
+
+/*!
+ * \brief An accessor for one level of the pyramid.
+ * \param index The level, 0 being full resolution
+ * \return The image at that level
+ */
+QImage ImagePyramid::level(int index) const {
+    return levels.value(index);
+}
+
+/*!
+ * \brief Find the smallest level that can still be shown at a given scale without upscaling.
+ * \param scale The display size divided by the full-resolution size
+ * \return The index of the level
+ */
+int ImagePyramid::levelFor(qreal scale) const {
+    if (levels.isEmpty()) {
+        return 0;
+    }
+    const int needed = qCeil(levels.first().width() * scale);
+    int index = 0;
+    while (index + 1 < levels.size() && levels[index + 1].width() >= needed) {
+        index++;
+    }
+    return index;
+}
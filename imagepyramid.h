@@ -0,0 +1,27 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <QImage>
+#include <QVector>
+
+/*!
+ * \brief A mip pyramid of an image: the image itself followed by copies of half the size of the previous one.
+ *
+ * Displaying an image at a small size can start from the smallest level that is still large enough,
+ * instead of rescaling the full-resolution image every time.
+ */
+class ImagePyramid {
+public:
+    ImagePyramid() = default;
+    void setImage(const QImage&);
+    void updateRegion(const QRect&, const QImage&);
+    bool isNull() const;
+    int levelCount() const;
+    QImage level(int) const;
+    int levelFor(qreal) const;
+private:
+    static const int SMALLEST_LEVEL; /*!< Levels stop halving once both sides are at most this many pixels */
+    QVector<QImage> levels; /*!< The levels, from full resolution down */
+};
+
+#endif // IMAGEPYRAMID_H
@@ -1,4 +1,6 @@
 #include "insertfilter.h"
+#include <QHash>
+#include <QThread>
 
 /*!
  * \brief An overloaded mutator for the movie variable and three residue images.
@@ -8,6 +10,7 @@
  * \param mov The gif image uploaded by the user
  */
 void InsertFilter::setMovie(QMovie *mov) {
+    FilterTrace::Span span("insert", "read frames");
     list.clear();
     movie = mov;
     mov->jumpToNextFrame();
@@ -32,6 +35,52 @@ void InsertFilter::setDestination(QString path) {
 QString InsertFilter::getDestination() {
     return destination;
 }
+/*!
+ * \brief Convert a frame to one palette index per pixel, if it has few enough colors.
+ *
+ * Frames decoded from a GIF have at most 256 colors, so they can be written back without building a new palette.
+ * The color table is exact, so untouched frames do not drift in color when the GIF is re-encoded.
+ *
+ * \param frame The frame to be converted
+ * \param indices The palette index of each pixel, row by row without padding
+ * \param colors The color table
+ * \return Whether the frame has at most 256 colors
+ */
+bool InsertFilter::indexFrame(const QImage &frame, QVector<uint8_t> &indices, QVector<QRgb> &colors) {
+    int height = frame.height();
+    int width = frame.width();
+    indices.resize(width * height);
+
+    // Already indexed, only drop the padding at the end of each scanline
+    if (frame.format() == QImage::Format_Indexed8) {
+        for (int i = 0; i < height; i++) {
+            memcpy(indices.data() + i * width, frame.constScanLine(i), width);
+        }
+        colors = frame.colorTable();
+        return true;
+    }
+
+    // Otherwise collect the colors one by one, giving up as soon as there are too many
+    QImage argb = frame.convertToFormat(QImage::Format_ARGB32);
+    QHash<QRgb, int> lookup;
+    colors.clear();
+    for (int i = 0; i < height; i++) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(argb.constScanLine(i));
+        for (int j = 0; j < width; j++) {
+            QHash<QRgb, int>::const_iterator found = lookup.constFind(line[j]);
+            if (found == lookup.constEnd()) {
+                if (colors.size() == 256) {
+                    return false;
+                }
+                found = lookup.insert(line[j], colors.size());
+                colors.append(line[j]);
+            }
+            indices[i * width + j] = static_cast<uint8_t>(found.value());
+        }
+    }
+    return true;
+}
+
 /*!
  * \brief Apply the filter to uploaded images.
  */
@@ -58,16 +107,26 @@ void InsertFilter::apply() {
 
     // Define some variables
     QVector < uint8_t > vector;
+    QVector < QRgb > colors;
     int height = movie->currentImage().height();
     int width = movie->currentImage().width();
     int delay = movie->nextFrameDelay() / 10; // divide by 10 since Qt counts in milliseconds but gif.h counts in hundredth of a second
 
     // Use external library gif.h to build a gif image from individual frames
+    FilterTrace::Span span("insert", "write gif");
     GifWriter g;
-    char *fileName = destination.toLocal8Bit().data();
-    GifBegin(&g, fileName, width, height, delay);
+    QByteArray fileName = destination.toLocal8Bit();
+    GifBegin(&g, fileName.constData(), width, height, delay);
+    GifSetThreads(&g, QThread::idealThreadCount(), 2 * QThread::idealThreadCount()); // quantize upcoming frames on all cores while frames are written in order
+    GifSetDepthPreset(&g, kGifDepthQuality); // frames with few changed colors get a smaller palette, without any loss
     QLinkedList<QImage>::iterator iter = list.begin(); // linked list iterator
     for (int i = 0; i < list.size(); i++, iter++, movie->jumpToNextFrame()) {
+        // Frames that came from the GIF keep their own palette
+        if (indexFrame(*iter, vector, colors)) {
+            GifWriteIndexedFrame(&g, vector.data(), colors.data(), colors.size(), width, height, delay);
+            continue;
+        }
+
         vector.clear();
         for (int j = 0; j < height; j++) {
             for (int k = 0; k < width; k++) {
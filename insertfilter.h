@@ -17,6 +17,7 @@ public:
     void setDestination(QString);
     virtual void apply() override;
 private:
+    static bool indexFrame(const QImage&, QVector<uint8_t>&, QVector<QRgb>&);
     QLinkedList<QImage> list; /*!< A linked list that stores individual frames of the gif for fast insertion */
     QString destination; /*!< The destination folder of the result gif image to be saved */
 };
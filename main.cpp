@@ -27,13 +27,22 @@
  *
  * After clicking "Save" in blurring, the blurred image and the three residue images will be saved inside a new folder.
  *
+ * To blur only part of the image, tick "selected regions only" and drag rectangles over the original image.
+ * Only the blocks touching them are blurred, the residue images only hold those blocks, and "tiles.txt" lists where they go.
+ * Keep "tiles.txt" in the folder when deblurring; the matching strength is selected when the folder is opened.
+ *
  * Before using the deblurring function, put the source image and the red, green, and blue residue images inside one folder.
  *
  * Name them "img.png", "red.png", "green.png", "blue.png" respectively.
  *
  * Then click "open folder" to open this source folder.
  *
- * During deblurring, <b>try all three possibilities</b> until you get a clear image.
+ * Leave the strength on "AUTO" and the program finds the strength the image was blurred with by itself,
+ * by deblurring a few sample blocks with every strength first. You can still pick a strength by hand.
+ *
+ * For large images, tick "visible region only" to deblur just the part shown in the result view.
+ * Zoom with the mouse wheel and drag to pan, and the newly visible part is deblurred when you stop.
+ * Press "Deblur" again with the box unticked, or save, to finish the rest of the image.
  *
  * \section feature2 2. Encode and Decode
  *
@@ -74,6 +83,8 @@
 
 int main(int argc, char *argv[]) {
     QApplication a(argc, argv);
+    QApplication::setOrganizationName("H22");
+    QApplication::setApplicationName("project_H22"); // names the settings and the cache directory
     MainWindow w;
     w.show();
     return a.exec();
@@ -1,6 +1,13 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include <QDebug>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QtConcurrent>
+#include "imageio.h"
+
+const int MainWindow::ROI_DELAY = 200;
 
 /*!
  * \brief the constructor to set up the ui and all the filters
@@ -27,6 +34,15 @@ MainWindow::MainWindow(QWidget *parent)
     ui->setupUi(this);
     setUI();
     setStrengthButton();
+
+    // deblur the visible region of the deblur result graph once the user stops panning or zooming
+    roiTimer.setSingleShot(true);
+    roiTimer.setInterval(ROI_DELAY);
+    connect(&roiTimer, &QTimer::timeout, this, &MainWindow::deblurVisibleRegion);
+    connect(ui->deblur_result_graph, &Graph::viewportChanged, this, [this]{
+        if (deblurStarted && ui->deblur_roi_check->isChecked())
+            roiTimer.start();
+    });
 }
 
 /*!
@@ -48,9 +64,6 @@ MainWindow::~MainWindow()
     for(int i = 0; i < 6; i++){
         delete movie[i];
     }
-    delete red;
-    delete green;
-    delete blue;
     delete strength_button;
     delete deblur_strength_button;
     delete ui;
@@ -180,6 +193,7 @@ void MainWindow::on_blur_open_button_clicked()
  * \brief triggered and apply the blurring effect.
  *
  * Blurring needs to pass the blursize which is given according to the strength_button. \
+ * When "selected regions only" is ticked, only the blocks touching the regions dragged on the original graph are blurred. \
  * Pop up a progress dialog to show the blurring speed and show the result on the result graph.
  */
 
@@ -190,20 +204,41 @@ void MainWindow::on_blur_button_clicked()
         msgBox.exec();
         return;
     }
+    QVector<QRect> regions;
+    if(ui->blur_roi_check->isChecked()){
+        regions = graphicsScene[blur_original_graph]->selectedRegions();
+        if(regions.isEmpty()){
+            msgBox.setText("Drag on the image to select the regions to blur");
+            msgBox.exec();
+            return;
+        }
+    }
 
-    // initialize filter
+    // initialize filter, only once the job is confirmed so that a cancelled one leaves the last result intact
     QImage image = graphicsScene[blur_original_graph]->getImage();
+    CostModel::Estimate cost = CostModel::estimate(CostModel::Blur, image.size(), strength);
+    if(!confirmCost("Blurring", cost)) return;
     blurFilter->setImage(image);
     blurFilter->setSize(strength);
+    blurFilter->setRegions(regions);
 
     // initialize progress dialog
     QProgressDialog progressDialog;
     progressDialog.setMaximum(blurFilter->getImage().height());
     progressDialog.setMinimumDuration(0);
     progressDialog.setValue(0);
-    progressDialog.setLabelText("Image blurring in Progress...");
+    progressDialog.setLabelText("Image blurring in Progress...\n" + CostModel::describeTime(cost.milliseconds) + " left");
     progressDialog.setAutoClose(true);
 
+    // show how long is left, from the prediction at first and from the pace so far later on
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QObject::connect(blurFilter, &BlurFilter::progressUpdated, &progressDialog, [&](int value){
+        double progress = static_cast<double>(value) / qMax(1, progressDialog.maximum());
+        qint64 left = CostModel::remaining(cost.milliseconds, elapsed.elapsed(), progress);
+        progressDialog.setLabelText("Image blurring in Progress...\n" + CostModel::describeTime(left) + " left");
+    });
+
     // receive signal when user presses "Cancel" button
     QObject::connect(&progressDialog,&QProgressDialog::canceled,blurFilter,&BlurFilter::isCancelled,Qt::UniqueConnection);
 
@@ -221,11 +256,30 @@ void MainWindow::on_blur_button_clicked()
     ui->blur_result_graph->setScene(graphicsScene[blur_result_graph]);
 }
 
+/*!
+ * \brief switch the blur original graph between panning and selecting the regions to blur.
+ *
+ * \param checked Whether "selected regions only" is ticked
+ */
+
+void MainWindow::on_blur_roi_check_toggled(bool checked)
+{
+    ui->blur_original_graph->setSelecting(checked);
+    if(!checked && graphicsScene[blur_original_graph] != nullptr){
+        graphicsScene[blur_original_graph]->clearSelections();
+    }
+}
+
 /*!
  * \brief save the blurred image and other three residues to one folder.
  *
  * To keep all the information of the original, we need to save the result into four images and \
- * save them under the directory using the name img.png, red.png, blue.png, and green.png.
+ * save them under the directory using the name img.png, red.png, blue.png, and green.png. \
+ * If only some regions were blurred, the residues only hold the blurred blocks, and tiles.txt \
+ * lists the block size followed by the top-left corner of every block in the order they are packed. \
+ * The four images are written at the same time on worker threads while a progress dialog is shown. \
+ * The residues look like noise and barely compress, so they are written with the fastest compression. \
+ * If the setting "files/intermediate" is "qoi", "pam" or "planar", the four images are written in that format instead.
  */
 
 void MainWindow::on_blur_save_button_clicked()
@@ -249,12 +303,47 @@ void MainWindow::on_blur_save_button_clicked()
     if(ok && !a.isEmpty()){
         bool flag = dir.mkdir(QString(a));
         if(flag){
-            graphicsScene[blur_result_graph]->getImage().save(filename+"/"+a+"/img.png");
-            blurFilter->getRedResidue().save(filename+"/"+a+"/red.png");
-            blurFilter->getGreenResidue().save(filename+"/"+a+"/green.png");
-            blurFilter->getBlueResidue().save(filename+"/"+a+"/blue.png");
-            msgBox.setText("Success");
-            msgBox.show();
+            // the block size the residues were packed with, which the strength buttons may no longer show
+            QVector<QPoint> tiles = blurFilter->getTiles();
+            if(!tiles.isEmpty()){
+                QFile file(filename+"/"+a+"/tiles.txt");
+                bool written = file.open(QIODevice::WriteOnly | QIODevice::Text);
+                if(written){
+                    QTextStream out(&file);
+                    out << "size " << blurFilter->getSize() << "\n";
+                    for(const QPoint &tile : tiles){
+                        out << tile.x() << " " << tile.y() << "\n";
+                    }
+                    out.flush();
+                    written = out.status() == QTextStream::Ok && file.error() == QFileDevice::NoError;
+                }
+                if(!written){
+                    msgBox.setText("Export Failed: cannot write tiles.txt");
+                    msgBox.exec();
+                    return;
+                }
+            }
+
+            // write the four images at once, as PNG or QOI depending on the settings
+            QString folder = filename+"/"+a;
+            QString suffix = "."+imageio::intermediateFormat();
+            QVector<imageio::Output> outputs{
+                {graphicsScene[blur_result_graph]->getImage(), folder+"/img"+suffix, imageio::Balanced},
+                {blurFilter->getRedResidue(), folder+"/red"+suffix, imageio::Fast},
+                {blurFilter->getGreenResidue(), folder+"/green"+suffix, imageio::Fast},
+                {blurFilter->getBlueResidue(), folder+"/blue"+suffix, imageio::Fast}};
+            QProgressDialog *progressDialog = new QProgressDialog("Saving blurred images...", QString(), 0, outputs.size(), this);
+            progressDialog->setMinimumDuration(0);
+            progressDialog->setValue(0);
+            QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+            connect(watcher, &QFutureWatcher<bool>::progressValueChanged, progressDialog, &QProgressDialog::setValue);
+            connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, progressDialog]{
+                progressDialog->deleteLater();
+                msgBox.setText(watcher->future().results().contains(false) ? "Export Failed" : "Success");
+                msgBox.show();
+                watcher->deleteLater();
+            });
+            watcher->setFuture(QtConcurrent::mapped(outputs, &imageio::writeOutput));
             return;
         }
     }
@@ -266,51 +355,88 @@ void MainWindow::on_blur_save_button_clicked()
  * \brief triggered when user opens the deblur's open source folder.
  *
  * we need four photos to deblur back to the original image. After all the conditions satisfied, \
- * show the result on the result graphview.
+ * show the result on the result graphview. If the folder has a tiles.txt, only the listed blocks \
+ * were blurred and the strength it was blurred with is selected. Only the headers of the images are \
+ * read here: the four images are read at the same time on worker threads, and a preview of the blurred \
+ * image is shown as soon as it is ready.
  */
 
 void MainWindow::on_deblur_open_button_clicked()
 {
-    // get image to be deblurred and three residue images. Also check if file names are correct
+    // check that the image to be deblurred and the three residue images are there, from their headers
     QString filename = QFileDialog::getExistingDirectory();
     if(filename=="") return;
-    QImage image{filename+"/img.png"};
-    if(image.isNull()){
-        msgBox.setText("Please make sure that the blurred image is named \"img.png\"");
+    QString imagePath = imageio::find(filename+"/img");
+    QSize imageSize = imageio::size(imagePath);
+    if(!imageSize.isValid()){
+        msgBox.setText("Please make sure that the blurred image is named \"img.png\", \"img.qoi\", \"img.pam\" or \"img.planar\"");
         msgBox.exec();
         return;
     }
-    red = new QImage(filename+"/red.png");
-    if(red->isNull()){
-        msgBox.setText("Please make sure that the red residue image is named \"red.png\"");
-        msgBox.exec();
-        return;
-    }
-    green = new QImage(filename+"/green.png");
-    if(green->isNull()){
-        msgBox.setText("Please make sure that the green residue image is named \"green.png\"");
-        msgBox.exec();
-        return;
+    QStringList residuePaths;
+    for(const QString &name : {QString("red"), QString("green"), QString("blue")}){
+        residuePaths << imageio::find(filename+"/"+name);
+        if(!imageio::size(residuePaths.last()).isValid()){
+            msgBox.setText("Please make sure that the "+name+" residue image is named \""+name+".png\", \""+name+".qoi\", \""+name+".pam\" or \""+name+".planar\"");
+            msgBox.exec();
+            return;
+        }
     }
-    blue = new QImage(filename+"/blue.png");
-    if(blue->isNull()){
-        msgBox.setText("Please make sure that the blue residue image is named \"blue.png\"");
-        msgBox.exec();
-        return;
+
+    // read the blurred blocks if only some regions were blurred
+    QVector<QPoint> tiles;
+    QFile tilesFile(filename+"/tiles.txt");
+    if(tilesFile.open(QIODevice::ReadOnly | QIODevice::Text)){
+        QTextStream in(&tilesFile);
+        QString word;
+        int size = 0;
+        in >> word >> size;
+        if(word != "size" || (size != 10 && size != 16 && size != 20)){
+            msgBox.setText("Please make sure that \"tiles.txt\" starts with the strength, e.g. \"size 10\"");
+            msgBox.exec();
+            return;
+        }
+        while(true){
+            int x = -1, y = -1;
+            in >> x >> y;
+            if(in.status() != QTextStream::Ok) break;
+            if(x < 0 || y < 0 || x >= imageSize.width() || y >= imageSize.height() || x % size != 0 || y % size != 0){
+                msgBox.setText("Please make sure that \"tiles.txt\" only lists blocks inside \"img.png\"");
+                msgBox.exec();
+                return;
+            }
+            tiles.append(QPoint(x, y));
+        }
+
+        // the blocks only line up with the strength they were blurred with
+        ui->deblur_low_button->setChecked(size == 10);
+        ui->deblur_medium_button->setChecked(size == 16);
+        ui->deblur_high_button->setChecked(size == 20);
+        deblur_strength = size;
     }
+    deblurTiles = tiles;
+    deblurStarted = false;
+    ui->deblur_auto_button->setText("AUTO");
 
-    // display image
+    // read the residues and display the image, all in the background
+    residueLoad = QtConcurrent::mapped(residuePaths, &imageio::read);
     graphicsScene[deblur_original_graph] = new GraphicsScene(ui->deblur_original_graph);
-    graphicsScene[deblur_original_graph]->setImage(image);
     ui->deblur_original_graph->setScene(graphicsScene[deblur_original_graph]);
+    connect(graphicsScene[deblur_original_graph], &GraphicsScene::loadFailed, this, [this]{
+        msgBox.setText("The blurred image cannot be read");
+        msgBox.exec();
+    });
+    graphicsScene[deblur_original_graph]->load(imagePath);
 }
 
 /*!
  * \brief apply the deblur function.
  *
- * show a progress dialog as the deblur function may take a long time. Show the result image on \
- * the deblur result graph. The three connect functions are to guarantee the effectiveness of the progress \
- * dialog box. Here we apply different deblursize according to the deblur_strength_button.
+ * The result graph starts with the blurred image and every block is replaced as soon as it is deblurred. \
+ * When "visible region only" is ticked, only the part of the result graph being looked at is deblurred, \
+ * and more is deblurred as the user pans or zooms. Pressing the button again with the box unticked finishes \
+ * the rest of the image without repeating any block. Here we apply different deblursize according to the \
+ * deblur_strength_button.
  */
 
 void MainWindow::on_deblur_button_clicked()
@@ -320,18 +446,104 @@ void MainWindow::on_deblur_button_clicked()
         msgBox.exec();
         return;
     }
+    if(deblurRunning) return;
+
+    if(!deblurStarted){
+        // wait for the residues if they are still being read
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        residueLoad.waitForFinished();
+        QImage image = graphicsScene[deblur_original_graph]->getImage();
+        QApplication::restoreOverrideCursor();
+        const QString names[3] = {"red", "green", "blue"};
+        for(int i = 0; i < 3; i++){
+            if(residueLoad.resultAt(i).isNull()){
+                msgBox.setText("The "+names[i]+" residue image cannot be read");
+                msgBox.exec();
+                return;
+            }
+        }
+        if(image.isNull()){
+            msgBox.setText("The blurred image cannot be read");
+            msgBox.exec();
+            return;
+        }
 
-    // initialize filter
-    deblurFilter->setImage(graphicsScene[deblur_original_graph]->getImage(),*red,*green,*blue);
-    deblurFilter->setSize(deblur_strength);
+        // initialize filter
+        deblurFilter->setImage(image,residueLoad.resultAt(0),residueLoad.resultAt(1),residueLoad.resultAt(2));
+        deblurFilter->setTiles(deblurTiles);
+        int size = deblur_strength;
+        if(size == 0){
+            // try every strength on a few sample blocks and keep the one that gives a valid image
+            QApplication::setOverrideCursor(Qt::WaitCursor);
+            size = deblurFilter->detectSize(QVector<int>{10, 16, 20});
+            QApplication::restoreOverrideCursor();
+            ui->deblur_auto_button->setText(size == 10 ? "AUTO (LOW)" : size == 16 ? "AUTO (MEDIUM)" : "AUTO (HIGH)");
+        }
+        deblurFilter->setSize(size);
+
+        // display the image while it is being deblurred
+        graphicsScene[deblur_result_graph] = new GraphicsScene(ui->deblur_result_graph);
+        graphicsScene[deblur_result_graph]->setImage(deblurFilter->getImage());
+        ui->deblur_result_graph->setScene(graphicsScene[deblur_result_graph]);
+        QObject::disconnect(deblurFilter, &DeblurFilter::regionUpdated, nullptr, nullptr);
+        QObject::connect(deblurFilter, &DeblurFilter::regionUpdated, graphicsScene[deblur_result_graph], &GraphicsScene::updateRegion);
+        deblurStarted = true;
+    }
+
+    QRect region = ui->deblur_roi_check->isChecked() ? graphicsScene[deblur_result_graph]->visibleRect() : QRect();
+    QSize area = region.isNull() ? deblurFilter->getImage().size() : region.size();
+    if(!deblurFilter->isComplete() && !confirmCost("Deblurring", CostModel::estimate(CostModel::Deblur, area, deblurFilter->getSize()))) return;
+    runDeblur(region, 0);
+}
+
+/*!
+ * \brief deblur the region of the deblur result graph that has become visible by panning or zooming.
+ *
+ * Nothing happens if a deblur is already running or the whole image is done.
+ */
+
+void MainWindow::deblurVisibleRegion()
+{
+    if(!deblurStarted || deblurFilter->isComplete() || graphicsScene[deblur_result_graph]==nullptr) return;
+    if(deblurRunning){
+        roiTimer.start(); // try again once the running deblur has finished
+        return;
+    }
+    runDeblur(graphicsScene[deblur_result_graph]->visibleRect(), 500);
+}
+
+/*!
+ * \brief run the deblur filter with a progress dialog.
+ *
+ * show a progress dialog as the deblur function may take a long time. The three connect functions \
+ * are to guarantee the effectiveness of the progress dialog box.
+ *
+ * \param region The region to deblur, or a null rectangle for the whole image
+ * \param minimumDuration How long in milliseconds the deblur must take before the dialog shows up
+ */
+
+void MainWindow::runDeblur(const QRect &region, int minimumDuration)
+{
+    QRect area = region.isNull() ? deblurFilter->getImage().rect() : region;
+    if(area.isEmpty()) return;
+    CostModel::Estimate cost = CostModel::estimate(CostModel::Deblur, area.size(), deblurFilter->getSize());
 
     // intialize progress dialog
     QProgressDialog progressDialog;
-    progressDialog.setMaximum(deblurFilter->getImage().height());
-    progressDialog.setMinimumDuration(0);
-    progressDialog.setLabelText("Image Deblurring in Progress...");
+    progressDialog.setRange(area.top(), area.bottom() + 1);
+    progressDialog.setMinimumDuration(minimumDuration);
+    progressDialog.setLabelText("Image Deblurring in Progress...\n" + CostModel::describeTime(cost.milliseconds) + " left");
     progressDialog.setAutoClose(true);
-    progressDialog.setValue(0);
+    progressDialog.setValue(area.top());
+
+    // show how long is left, from the prediction at first and from the pace so far later on
+    QElapsedTimer elapsed;
+    elapsed.start();
+    QObject::connect(deblurFilter, &DeblurFilter::progressUpdated, &progressDialog, [&](int value){
+        double progress = static_cast<double>(value - area.top()) / qMax(1, area.height());
+        qint64 left = CostModel::remaining(cost.milliseconds, elapsed.elapsed(), progress);
+        progressDialog.setLabelText("Image Deblurring in Progress...\n" + CostModel::describeTime(left) + " left");
+    });
 
     // receive signal when user presses "Cancel" button
     QObject::connect(&progressDialog,&QProgressDialog::canceled,deblurFilter,&DeblurFilter::isCancelled,Qt::UniqueConnection);
@@ -341,13 +553,41 @@ void MainWindow::on_deblur_button_clicked()
 
     // force the application to switch thread
     QObject::connect(deblurFilter, &DeblurFilter::progressUpdated, this, []{QApplication::processEvents();},Qt::UniqueConnection);
-    deblurFilter->apply();
 
-    // display image
-    graphicsScene[deblur_result_graph] = new GraphicsScene(ui->deblur_result_graph);
-    graphicsScene[deblur_result_graph]->setImage(deblurFilter->getImage());
-    ui->deblur_result_graph->setScene(graphicsScene[deblur_result_graph]);
+    deblurRunning = true;
+    if(region.isNull()){
+        deblurFilter->apply();
+    }else{
+        deblurFilter->applyRegion(region);
+    }
+    deblurRunning = false;
+
+    // the first blocks showed that the strength or the residues are wrong
+    if(!deblurFilter->getError().isEmpty()){
+        progressDialog.close();
+        deblurStarted = false;
+        graphicsScene[deblur_result_graph]->setImage(graphicsScene[deblur_original_graph]->getImage());
+        msgBox.setText(deblurFilter->getError());
+        msgBox.exec();
+    }
+}
+
+/*!
+ * \brief ask the user whether to go on with a job predicted to be long or to need much memory.
+ *
+ * Jobs under CostModel::TIME_WARNING and CostModel::MEMORY_WARNING start without asking.
+ *
+ * \param job What the job does, e.g. "Deblurring"
+ * \param cost The prediction of the job
+ * \return Whether the job should start
+ */
 
+bool MainWindow::confirmCost(const QString &job, const CostModel::Estimate &cost)
+{
+    if(!CostModel::isLong(cost)) return true;
+    QString text = job + " will take " + CostModel::describeTime(cost.milliseconds) + " and use about "
+            + CostModel::describeMemory(cost.bytes) + " of memory. Start anyway?";
+    return QMessageBox::question(this, job, text) == QMessageBox::Yes;
 }
 
 /*!
@@ -358,6 +598,11 @@ void MainWindow::on_deblur_button_clicked()
 
 void MainWindow::on_deblur_save_button_clicked()
 {
+    if(deblurStarted && !deblurRunning && !deblurFilter->isComplete()){
+        // only part of the image has been deblurred, finish the rest first
+        runDeblur(QRect(), 0);
+        if(!deblurFilter->isComplete()) return;
+    }
     savePicture(graphicsScene[deblur_result_graph]);
 }
 
@@ -562,6 +807,8 @@ void MainWindow::on_extract_save_button_clicked()
  * \param b
  * the widget to accomodate the image
  *
+ * The image is read on worker threads, so the window stays responsive: a preview scaled down to the \
+ * graph is shown first and replaced by the full image once it has been read.
  */
 
 void MainWindow::setPicture(Graph* &a, GraphicsScene* &b){
@@ -569,13 +816,16 @@ void MainWindow::setPicture(Graph* &a, GraphicsScene* &b){
         this,
         tr("Open File"),
         "",
-        tr("JPEG (*.jpg *.jpeg);;PNG (*.png)" )
+        tr("JPEG (*.jpg *.jpeg);;PNG (*.png);;QOI (*.qoi);;PNM (*.pgm *.ppm *.pam *.planar)" )
     );
     if(imagePath=="") return;
-    QImage image{imagePath};
     b = new GraphicsScene(a);
-    b->setImage(image);
     a->setScene(b);
+    connect(b, &GraphicsScene::loadFailed, this, [this, imagePath]{
+        msgBox.setText("\""+QFileInfo(imagePath).fileName()+"\" cannot be read");
+        msgBox.exec();
+    });
+    b->load(imagePath);
 }
 
 void MainWindow::setDefaultPicture(Graph *& a, GraphicsScene *& b, QImage c){
@@ -589,7 +839,7 @@ void MainWindow::setDefaultPicture(Graph *& a, GraphicsScene *& b, QImage c){
  * \brief save the image given which graphics scene requires.
  *
  * Pop up the dialog box when there is no image to save.
- * Currently only support to save PNG format.
+ * Saves PNG, or QOI, PGM, PPM, PAM or planar PAM when the file name ends with .qoi, .pgm, .ppm, .pam or .planar.
  * A success dialog box will be shown if the filepath is valid.
  *
  */
@@ -604,11 +854,11 @@ void MainWindow::savePicture(GraphicsScene *& a){
         this,
         tr("Save Image File"),
         "",
-        tr("PNG (*.png)" )
+        tr("PNG (*.png);;QOI (*.qoi);;PNM (*.pgm *.ppm *.pam *.planar)" )
     );
     if (!fileName.isEmpty())
     {
-      a->getImage().save(fileName);
+      imageio::write(a->getImage(), fileName);
       msgBox.setText("Success");
       msgBox.exec();
     }
@@ -645,7 +895,8 @@ void MainWindow::setStrengthButton(){
     deblur_strength_button->addButton(ui->deblur_low_button,0);
     deblur_strength_button->addButton(ui->deblur_medium_button,1);
     deblur_strength_button->addButton(ui->deblur_high_button,2);
-    ui->deblur_low_button->setChecked(true);
+    deblur_strength_button->addButton(ui->deblur_auto_button,3);
+    ui->deblur_auto_button->setChecked(true);
 
     // receive signal when user selects a strength option
     connect(ui->deblur_low_button,SIGNAL(clicked(bool)),
@@ -654,6 +905,8 @@ void MainWindow::setStrengthButton(){
                 this,SLOT(on_deblur_strength_button_clicked()));
     connect(ui->deblur_high_button,SIGNAL(clicked(bool)),
                 this,SLOT(on_deblur_strength_button_clicked()));
+    connect(ui->deblur_auto_button,SIGNAL(clicked(bool)),
+                this,SLOT(on_deblur_strength_button_clicked()));
 }
 /*!
  *
@@ -680,7 +933,8 @@ void MainWindow::on_strength_button_clicked(){
 /*!
  * \brief triggered when different strength is selected.
  *
- * for low strength, the blursize is 10, for medium is 16 and high is 20.
+ * for low strength, the blursize is 10, for medium is 16 and high is 20. \
+ * For auto, the blursize is found when deblurring starts.
  */
 
 void MainWindow::on_deblur_strength_button_clicked(){
@@ -695,7 +949,11 @@ void MainWindow::on_deblur_strength_button_clicked(){
         case 2:
             deblur_strength = 20;
                break;
+        case 3:
+            deblur_strength = 0;
+            break;
     }
+    deblurStarted = false;
 }
 
 /*!
@@ -775,7 +1033,5 @@ void MainWindow::setUI(){
 
     const QString deblur = ":/image/deblur.png";
     setDefaultPicture(ui->deblur_original_graph,graphicsScene[deblur_original_graph],QImage{deblur});
-    red = new QImage{":/image/red.png"};
-    green = new QImage{":/image/green.png"};
-    blue = new QImage{":/image/blue.png"};
+    residueLoad = QtConcurrent::mapped(QStringList{":/image/red.png", ":/image/green.png", ":/image/blue.png"}, &imageio::read);
 }
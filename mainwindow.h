@@ -9,6 +9,8 @@
 #include <QLabel>
 #include <QInputDialog>
 #include <QButtonGroup>
+#include <QTimer>
+#include <QFuture>
 #include "blurfilter.h"
 #include "deblurfilter.h"
 #include "encodefilter.h"
@@ -16,6 +18,7 @@
 #include "insertfilter.h"
 #include "graphicscene.h"
 #include "extractfilter.h"
+#include "costmodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -75,18 +78,23 @@ private:
     DecodeFilter *decodeFilter;
     InsertFilter *insertFilter;
     ExtractFilter *extractFilter;
-    QImage *red = nullptr;
-    QImage *green = nullptr;
-    QImage *blue = nullptr;
+    QFuture<QImage> residueLoad; /*!< Reads the red, green and blue residues of the opened deblur folder in the background, in that order */
+    QVector<QPoint> deblurTiles; /*!< The blurred blocks listed in tiles.txt of the opened deblur folder, empty if its residues cover the whole image */
     QMessageBox msgBox;
     QButtonGroup *strength_button = nullptr;
     QButtonGroup *deblur_strength_button = nullptr;
     QString insertMoviePath, extractMoviePath;
     int strength = 10;
-    int deblur_strength = 10;
+    int deblur_strength = 0; /*!< The deblur strength, 0 to find it automatically */
+    bool deblurStarted = false; /*!< The deblur filter holds the images shown in the deblur result graph, possibly only partly deblurred */
+    bool deblurRunning = false; /*!< The deblur filter is running, so it must not be started again */
+    QTimer roiTimer; /*!< Restarted whenever the deblur result graph is panned or zoomed, to deblur the visible region once it stops */
+    static const int ROI_DELAY; /*!< How long in milliseconds the deblur result graph must stay still before its visible region is deblurred */
     void setPicture(Graph*&, GraphicsScene*&);
     void setDefaultPicture(Graph*&, GraphicsScene*&, QImage);
     void savePicture(GraphicsScene*&);
+    void runDeblur(const QRect&, int);
+    bool confirmCost(const QString&, const CostModel::Estimate&);
     void setStrengthButton();
     void setUI();
 
@@ -113,5 +121,7 @@ private slots:
     void on_strength_button_clicked();
     void on_deblur_strength_button_clicked();
     void on_checkBox_stateChanged();
+    void on_blur_roi_check_toggled(bool);
+    void deblurVisibleRegion();
 };
 #endif // MAINWINDOW_H
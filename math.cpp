@@ -1,4 +1,5 @@
 #include "math.h"
+#include "filtertrace.h"
 
 /*!
  * \brief Check is a double value is actually zero.
@@ -64,6 +65,7 @@ void math::rref(double **a, int n, int m) {
         }
         r++;
     }
+    FilterTrace::add(FilterTrace::Pivots, r);
 }
 
 /*!
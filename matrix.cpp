@@ -1,4 +1,5 @@
 #include "matrix.h"
+#include "filtertrace.h"
 
 /*!
  * \brief For each element in a certain region of a 2D array, replace its value with the average of all the values that are within a certain Manhattan distance from it (including the element itself).
@@ -22,9 +23,11 @@
  * \param size The size of the region
  */
 void matrix::blurMatrix(double **input, int h, int w, int x, int y, int size) {
+    FilterTrace::Span span("matrix", "blur block", true);
     int xSize = min(size, h - x); // resize the height of the selected region to avoid accessing non-existent pixels
     int ySize = min(size, w - y); // resize the width of the selected region to avoid accessing non-existent pixels
     int n = xSize * ySize;
+    span.setPixels(n);
     int d = min(xSize / 2, ySize / 2); // set the appropriate Manhattan distance
 
     // Initialize dynamic arrays
@@ -37,6 +40,8 @@ void matrix::blurMatrix(double **input, int h, int w, int x, int y, int size) {
             a[i][j] = 0;
         }
     }
+    FilterTrace::add(FilterTrace::Allocations, n + 1);
+    FilterTrace::add(FilterTrace::Blocks, 1);
 
     // Perform blurring
     for (int i = x; i < x + xSize; i++) {
@@ -94,9 +99,11 @@ void matrix::blurMatrix(double **input, int h, int w, int x, int y, int size) {
  */
 void matrix::deblurMatrix(double **input, int h, int w, int x, int y,
         int size) {
+    FilterTrace::Span span("matrix", "build system", true);
     int xSize = min(size, h - x); // resize the height of the selected region to avoid accessing non-existent pixels.
     int ySize = min(size, w - y); // resize the width of the selected region to avoid accessing non-existent pixels.
     int n = xSize * ySize;
+    span.setPixels(n);
     int d = min(xSize / 2, ySize / 2); // set the appropriate Manhattan distance
 
     // Initialize dynamic arrays
@@ -109,6 +116,8 @@ void matrix::deblurMatrix(double **input, int h, int w, int x, int y,
             a[i][j] = 0;
         }
     }
+    FilterTrace::add(FilterTrace::Allocations, n + 1);
+    FilterTrace::add(FilterTrace::Blocks, 1);
 
     // Construct matrix
     for (int i = x; i < min(h, x + size); i++) {
@@ -131,7 +140,9 @@ void matrix::deblurMatrix(double **input, int h, int w, int x, int y,
     }
 
     // Perform row-reduction algorithm
+    span.next("solve");
     math::rref(a, n, n + 1);
+    span.next("write back");
 
     // Put result values back into input matrices
     for (int i = x; i < min(h, x + size); i++) {
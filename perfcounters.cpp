@@ -0,0 +1,127 @@
+#include "perfcounters.h"
+#include <cstring>
+
+#ifdef Q_OS_LINUX
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+
+namespace {
+
+/*!
+ * \brief The counters of one thread.
+ */
+struct ThreadCounters {
+    int fds[PerfCounters::EventCount] = {-1, -1, -1, -1}; /*!< The file descriptors, the first one leading the group */
+    bool tried = false; /*!< Whether opening has been tried on this thread */
+    int error = 0; /*!< The errno of the failed open, 0 if they are open */
+
+    ~ThreadCounters() {
+        for (int fd : fds) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+};
+
+/*!
+ * \brief Open the counters of the calling thread, the first time it asks.
+ * \return The counters, with error set if they could not be opened
+ */
+ThreadCounters &threadCounters() {
+    thread_local ThreadCounters counters;
+    if (counters.tried) {
+        return counters;
+    }
+    counters.tried = true;
+    const quint64 configs[PerfCounters::EventCount] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int k = 0; k < PerfCounters::EventCount; k++) {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[k];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.exclude_kernel = 1; // allowed without privileges when perf_event_paranoid is 2 or less
+        attr.exclude_hv = 1;
+        attr.disabled = k == 0; // the whole group starts with its leader
+        int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, k == 0 ? -1 : counters.fds[0], 0));
+        if (fd < 0) {
+            counters.error = errno;
+            return counters;
+        }
+        counters.fds[k] = fd;
+    }
+    ioctl(counters.fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return counters;
+}
+
+}
+#endif
+
+/*!
+ * \brief Open the counters of the calling thread, to find out if counting works here.
+ * \param error Set to why counting does not work, if it does not
+ * \return Whether the counters could be opened
+ */
+bool PerfCounters::open(QString &error) {
+#ifdef Q_OS_LINUX
+    ThreadCounters &counters = threadCounters();
+    if (counters.error != 0) {
+        error = QString("perf_event_open failed: %1; hardware counters may not be exposed here (e.g. in a VM), "
+                "or /proc/sys/kernel/perf_event_paranoid may need to be 2 or less").arg(strerror(counters.error));
+        return false;
+    }
+    return true;
+#else
+    error = "hardware counters are only read on Linux";
+    return false;
+#endif
+}
+
+/*!
+ * \brief Read the counters of the calling thread, opening them if it is the first time.
+ * \param values Set to the EventCount counts since the counters were opened
+ * \return Whether the counters could be read
+ */
+bool PerfCounters::read(quint64 *values) {
+#ifdef Q_OS_LINUX
+    ThreadCounters &counters = threadCounters();
+    if (counters.error != 0) {
+        return false;
+    }
+    quint64 group[1 + EventCount]; // the number of events, then their counts
+    if (::read(counters.fds[0], group, sizeof(group)) != static_cast<ssize_t>(sizeof(group))) {
+        return false;
+    }
+    memcpy(values, group + 1, sizeof(quint64) * EventCount);
+    return true;
+#else
+    Q_UNUSED(values);
+    return false;
+#endif
+}
+
+/*!
+ * \brief The name of an event, as shown in reports.
+ * \param event The event
+ * \return The name
+ */
+const char *PerfCounters::name(Event event) {
+    switch (event) {
+    case Cycles:
+        return "cycles";
+    case Instructions:
+        return "instructions";
+    case CacheMisses:
+        return "cache misses";
+    case BranchMisses:
+        return "branch misses";
+    default:
+        return "";
+    }
+}
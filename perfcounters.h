@@ -0,0 +1,33 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <QString>
+#include <QtGlobal>
+
+/*!
+ * \brief Hardware performance counters of the calling thread, read with Linux perf_event_open.
+ *
+ * Every thread opens its own group of counters the first time it reads them, counting only user-space \
+ * work of that thread. On other systems, or when the kernel does not allow it (see \
+ * /proc/sys/kernel/perf_event_paranoid), open() fails and nothing is counted.
+ */
+class PerfCounters {
+public:
+    PerfCounters() = delete;
+
+    /*!
+     * \brief The hardware events counted.
+     */
+    enum Event {
+        Cycles, /*!< CPU cycles */
+        Instructions, /*!< Instructions retired */
+        CacheMisses, /*!< Last-level cache misses */
+        BranchMisses, /*!< Mispredicted branches */
+        EventCount /*!< The number of events */
+    };
+    static bool open(QString&);
+    static bool read(quint64*);
+    static const char *name(Event);
+};
+
+#endif // PERFCOUNTERS_H
@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -15,37 +15,21 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(filters.pri)
+
 SOURCES += \
-    animationfilter.cpp \
-    extractfilter.cpp \
-    gif.cpp \
     graph.cpp \
     graphicscene.cpp \
+    imagepyramid.cpp \
     main.cpp \
     mainwindow.cpp \
-    basefilter.cpp \
-    blurfilter.cpp \
-    deblurfilter.cpp \
-    decodefilter.cpp \
-    encodefilter.cpp \
-    insertfilter.cpp \
-    math.cpp \
-    matrix.cpp
+    tiledimageitem.cpp
 
 HEADERS += \
-    animationfilter.h \
-    basefilter.h \
-    blurfilter.h \
-    deblurfilter.h \
-    decodefilter.h \
-    encodefilter.h \
-    extractfilter.h \
-    gif.h \
     graph.h \
     graphicscene.h \
-    insertfilter.h \
-    math.h \
-    matrix.h \
+    imagepyramid.h \
+    tiledimageitem.h \
     mainwindow.h
 
 FORMS += \
@@ -0,0 +1,222 @@
+#include "qoicodec.h"
+#include <cstring>
+#include <limits>
+
+const int qoicodec::HEADER_SIZE = 14;
+
+const quint32 qoicodec::MAX_PIXELS = 400000000;
+
+namespace {
+
+const uchar OP_INDEX = 0x00; // 00xxxxxx: the color at this position of the index
+const uchar OP_DIFF = 0x40; // 01rrggbb: each channel differs from the previous pixel by -2..1
+const uchar OP_LUMA = 0x80; // 10gggggg rrrrbbbb: green differs by -32..31, red and blue by -8..7 more than green
+const uchar OP_RUN = 0xC0; // 11xxxxxx: the previous pixel repeated 1..62 times
+const uchar OP_RGB = 0xFE; // then red, green and blue
+const uchar OP_RGBA = 0xFF; // then red, green, blue and alpha
+const uchar MASK = 0xC0;
+const uchar END[8] = {0, 0, 0, 0, 0, 0, 0, 1}; // the stream ends with seven 0 bytes and a 1
+
+/*!
+ * \brief Where a color is kept in the index of recently seen colors.
+ * \param px The color
+ * \return The position, 0 to 63
+ */
+inline int indexOf(QRgb px) {
+    return (qRed(px) * 3 + qGreen(px) * 5 + qBlue(px) * 7 + qAlpha(px) * 11) % 64;
+}
+
+/*!
+ * \brief Write a 32-bit number, most significant byte first.
+ */
+inline void writeBig(uchar *p, quint32 v) {
+    p[0] = static_cast<uchar>(v >> 24);
+    p[1] = static_cast<uchar>(v >> 16);
+    p[2] = static_cast<uchar>(v >> 8);
+    p[3] = static_cast<uchar>(v);
+}
+
+/*!
+ * \brief Read a 32-bit number, most significant byte first.
+ */
+inline quint32 readBig(const uchar *p) {
+    return (quint32(p[0]) << 24) | (quint32(p[1]) << 16) | (quint32(p[2]) << 8) | quint32(p[3]);
+}
+
+}
+
+/*!
+ * \brief Check if bytes start with a QOI header.
+ * \param data The bytes, at least the first HEADER_SIZE of the file
+ * \return Whether they do
+ */
+bool qoicodec::canDecode(const QByteArray &data) {
+    return data.size() >= HEADER_SIZE && memcmp(data.constData(), "qoif", 4) == 0;
+}
+
+/*!
+ * \brief Read the size of an image from its header.
+ * \param data The bytes, at least the first HEADER_SIZE of the file
+ * \return The size, or an invalid size if they are not QOI
+ */
+QSize qoicodec::size(const QByteArray &data) {
+    if (!canDecode(data)) {
+        return QSize();
+    }
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+    return QSize(static_cast<int>(readBig(p + 4)), static_cast<int>(readBig(p + 8)));
+}
+
+/*!
+ * \brief Encode an image. Images with an alpha channel keep it, the others are written with three channels.
+ * \param img The image
+ * \return The file, or an empty array if the image is null
+ */
+QByteArray qoicodec::encode(const QImage &img) {
+    if (img.isNull()) {
+        return QByteArray();
+    }
+    bool alpha = img.hasAlphaChannel();
+    QImage image = img.convertToFormat(alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    int h = image.height();
+    int w = image.width();
+
+    // Every pixel takes at most 5 bytes, the buffer is cut to size at the end
+    qint64 worst = HEADER_SIZE + qint64(w) * h * (alpha ? 5 : 4) + qint64(sizeof(END));
+    if (worst > std::numeric_limits<int>::max()) {
+        return QByteArray(); // too large for a QByteArray
+    }
+    QByteArray data;
+    data.resize(static_cast<int>(worst));
+    uchar *out = reinterpret_cast<uchar*>(data.data());
+    memcpy(out, "qoif", 4);
+    writeBig(out + 4, static_cast<quint32>(w));
+    writeBig(out + 8, static_cast<quint32>(h));
+    out[12] = alpha ? 4 : 3;
+    out[13] = 0; // sRGB with linear alpha
+    int p = HEADER_SIZE;
+
+    QRgb index[64] = {};
+    QRgb prev = qRgba(0, 0, 0, 255);
+    int run = 0;
+    for (int i = 0; i < h; i++) {
+        const QRgb *line = reinterpret_cast<const QRgb*>(image.constScanLine(i));
+        for (int j = 0; j < w; j++) {
+            QRgb px = alpha ? line[j] : (line[j] | 0xFF000000); // RGB32 leaves the alpha byte undefined
+            if (px == prev) {
+                run++;
+                if (run == 62) {
+                    out[p++] = OP_RUN | (run - 1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                out[p++] = OP_RUN | (run - 1);
+                run = 0;
+            }
+            int k = indexOf(px);
+            if (index[k] == px) {
+                out[p++] = OP_INDEX | k;
+            } else {
+                index[k] = px;
+                if (qAlpha(px) == qAlpha(prev)) {
+                    // signed char keeps the wrap-around of the format: 0 - 255 is a difference of 1
+                    signed char dr = static_cast<signed char>(qRed(px) - qRed(prev));
+                    signed char dg = static_cast<signed char>(qGreen(px) - qGreen(prev));
+                    signed char db = static_cast<signed char>(qBlue(px) - qBlue(prev));
+                    signed char drg = static_cast<signed char>(dr - dg);
+                    signed char dbg = static_cast<signed char>(db - dg);
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        out[p++] = OP_DIFF | ((dr + 2) << 4) | ((dg + 2) << 2) | (db + 2);
+                    } else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+                        out[p++] = OP_LUMA | (dg + 32);
+                        out[p++] = static_cast<uchar>(((drg + 8) << 4) | (dbg + 8));
+                    } else {
+                        out[p++] = OP_RGB;
+                        out[p++] = static_cast<uchar>(qRed(px));
+                        out[p++] = static_cast<uchar>(qGreen(px));
+                        out[p++] = static_cast<uchar>(qBlue(px));
+                    }
+                } else {
+                    out[p++] = OP_RGBA;
+                    out[p++] = static_cast<uchar>(qRed(px));
+                    out[p++] = static_cast<uchar>(qGreen(px));
+                    out[p++] = static_cast<uchar>(qBlue(px));
+                    out[p++] = static_cast<uchar>(qAlpha(px));
+                }
+            }
+            prev = px;
+        }
+    }
+    if (run > 0) {
+        out[p++] = OP_RUN | (run - 1);
+    }
+    memcpy(out + p, END, sizeof(END));
+    p += sizeof(END);
+    data.resize(p);
+    return data;
+}
+
+/*!
+ * \brief Decode an image.
+ *
+ * Images with four channels are returned as ARGB32, the others as RGB32. A stream that ends early leaves \
+ * the rest of the image black rather than failing, like a truncated PNG.
+ *
+ * \param data The file
+ * \return The image, or a null image if the header is not QOI or the size is out of range
+ */
+QImage qoicodec::decode(const QByteArray &data) {
+    QSize sz = size(data);
+    const uchar *in = reinterpret_cast<const uchar*>(data.constData());
+    if (sz.isEmpty() || quint64(sz.width()) * quint64(sz.height()) > MAX_PIXELS || (in[12] != 3 && in[12] != 4)) {
+        return QImage();
+    }
+    bool alpha = in[12] == 4;
+    QImage image(sz, alpha ? QImage::Format_ARGB32 : QImage::Format_RGB32);
+    if (image.isNull()) {
+        return QImage(); // out of memory
+    }
+    image.fill(qRgb(0, 0, 0));
+
+    int end = data.size() - static_cast<int>(sizeof(END));
+    int p = HEADER_SIZE;
+    QRgb index[64] = {};
+    QRgb px = qRgba(0, 0, 0, 255);
+    int run = 0;
+    for (int i = 0; i < sz.height(); i++) {
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(i));
+        for (int j = 0; j < sz.width(); j++) {
+            if (run > 0) {
+                run--;
+            } else if (p < end) {
+                uchar op = in[p++];
+                if (op == OP_RGB) {
+                    px = qRgba(in[p], in[p + 1], in[p + 2], qAlpha(px));
+                    p += 3;
+                } else if (op == OP_RGBA) {
+                    px = qRgba(in[p], in[p + 1], in[p + 2], in[p + 3]);
+                    p += 4;
+                } else if ((op & MASK) == OP_INDEX) {
+                    px = index[op];
+                } else if ((op & MASK) == OP_DIFF) {
+                    px = qRgba((qRed(px) + ((op >> 4) & 3) - 2) & 0xFF, (qGreen(px) + ((op >> 2) & 3) - 2) & 0xFF,
+                            (qBlue(px) + (op & 3) - 2) & 0xFF, qAlpha(px));
+                } else if ((op & MASK) == OP_LUMA) {
+                    int dg = (op & 0x3F) - 32;
+                    uchar next = in[p++];
+                    px = qRgba((qRed(px) + dg + (next >> 4) - 8) & 0xFF, (qGreen(px) + dg) & 0xFF,
+                            (qBlue(px) + dg + (next & 0x0F) - 8) & 0xFF, qAlpha(px));
+                } else {
+                    run = op & 0x3F;
+                }
+                index[indexOf(px)] = px;
+            } else {
+                return image; // truncated
+            }
+            line[j] = px;
+        }
+    }
+    return image;
+}
@@ -0,0 +1,28 @@
+#ifndef QOICODEC_H
+#define QOICODEC_H
+
+#include <QByteArray>
+#include <QImage>
+#include <QSize>
+
+/*!
+ * \brief A class encoding and decoding images in the QOI format ("Quite OK Image", https://qoiformat.org).
+ *
+ * QOI is lossless like PNG, but has no entropy coder: every pixel becomes a run, an index into the last 64 \
+ * colors, a small difference from the previous pixel, or the color itself. It is several times faster than \
+ * zlib both ways, which matters for the intermediate images written and read back by the workflow, and \
+ * about as small on residues and cipher images, which zlib barely compresses anyway.
+ */
+class qoicodec {
+public:
+    qoicodec() = delete;
+    static bool canDecode(const QByteArray&);
+    static QSize size(const QByteArray&);
+    static QByteArray encode(const QImage&);
+    static QImage decode(const QByteArray&);
+    static const int HEADER_SIZE; /*!< The bytes of the header, enough for canDecode() and size() */
+private:
+    static const quint32 MAX_PIXELS; /*!< The largest image decoded, to refuse corrupt headers before allocating */
+};
+
+#endif // QOICODEC_H
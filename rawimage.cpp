@@ -0,0 +1,357 @@
+#include "rawimage.h"
+#include <QFile>
+#include <QFileInfo>
+#include <cctype>
+#include <cstring>
+#include <limits>
+
+const int rawimage::ALIGNMENT = 64;
+
+const int rawimage::MAX_HEADER = 4096;
+
+namespace {
+
+/*!
+ * \brief Read the next token of a PGM or PPM header, skipping whitespace and comments.
+ * \param data The file
+ * \param length The bytes that may hold the header
+ * \param pos Where to start, moved past the token
+ * \return The token, empty if the header ends first
+ */
+QByteArray nextToken(const uchar *data, qint64 length, qint64 &pos) {
+    while (pos < length) {
+        if (data[pos] == '#') {
+            while (pos < length && data[pos] != '\n') {
+                pos++;
+            }
+        } else if (isspace(data[pos])) {
+            pos++;
+        } else {
+            break;
+        }
+    }
+    qint64 start = pos;
+    while (pos < length && !isspace(data[pos]) && data[pos] != '#') {
+        pos++;
+    }
+    return QByteArray(reinterpret_cast<const char*>(data + start), static_cast<int>(pos - start));
+}
+
+/*!
+ * \brief The QImage format holding samples of a depth as they are stored in the files.
+ * \param depth The samples per pixel
+ * \return Grayscale8, RGB888 or RGBA8888, Format_Invalid for other depths
+ */
+QImage::Format formatFor(int depth) {
+    return depth == 1 ? QImage::Format_Grayscale8 : depth == 3 ? QImage::Format_RGB888
+            : depth == 4 ? QImage::Format_RGBA8888 : QImage::Format_Invalid;
+}
+
+}
+
+/*!
+ * \brief Check if bytes start like a file read by read(): binary PGM, PPM or PAM.
+ * \param data The first bytes of the file
+ * \return Whether they do; the header may still describe samples read() leaves to Qt
+ */
+bool rawimage::canRead(const QByteArray &data) {
+    return data.size() >= 3 && data[0] == 'P' && (data[1] == '5' || data[1] == '6' || data[1] == '7')
+            && isspace(static_cast<uchar>(data[2]));
+}
+
+/*!
+ * \brief Check if a file name asks for a format written by write().
+ * \param path The file
+ * \return Whether it ends in .pgm, .ppm, .pam or .planar
+ */
+bool rawimage::canWrite(const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    return suffix == "pgm" || suffix == "ppm" || suffix == "pam" || suffix == "planar";
+}
+
+/*!
+ * \brief Read the header of a binary PGM, PPM or PAM file.
+ * \param data The file
+ * \param length Its size
+ * \return The header, not valid if it cannot be read or the samples are not 8-bit
+ */
+rawimage::Header rawimage::parse(const uchar *data, qint64 length) {
+    Header header;
+    qint64 end = qMin<qint64>(length, MAX_HEADER);
+    if (end < 3 || data[0] != 'P') {
+        return header;
+    }
+    int maxval = 0;
+    qint64 pos = 2;
+    if (data[1] == '5' || data[1] == '6') {
+        header.depth = data[1] == '5' ? 1 : 3;
+        header.width = nextToken(data, end, pos).toInt();
+        header.height = nextToken(data, end, pos).toInt();
+        maxval = nextToken(data, end, pos).toInt();
+        pos++; // exactly one whitespace character separates the header from the pixels
+    } else if (data[1] == '7') {
+        // One "KEY value" per line until ENDHDR
+        QByteArray tupleType;
+        while (true) {
+            qint64 lineEnd = pos;
+            while (lineEnd < end && data[lineEnd] != '\n') {
+                lineEnd++;
+            }
+            if (lineEnd >= end) {
+                return header;
+            }
+            QByteArray line = QByteArray(reinterpret_cast<const char*>(data + pos), static_cast<int>(lineEnd - pos)).trimmed();
+            pos = lineEnd + 1;
+            if (line.isEmpty() || line.startsWith('#')) {
+                continue;
+            }
+            if (line == "ENDHDR") {
+                break;
+            }
+            int space = line.indexOf(' ');
+            QByteArray key = line.left(space);
+            QByteArray value = space < 0 ? QByteArray() : line.mid(space + 1).trimmed();
+            if (key == "WIDTH") {
+                header.width = value.toInt();
+            } else if (key == "HEIGHT") {
+                header.height = value.toInt();
+            } else if (key == "DEPTH") {
+                header.depth = value.toInt();
+            } else if (key == "MAXVAL") {
+                maxval = value.toInt();
+            } else if (key == "TUPLTYPE") {
+                tupleType = value;
+            }
+        }
+        header.planar = tupleType.endsWith("_PLANAR");
+    } else {
+        return header;
+    }
+    header.offset = pos;
+    header.valid = header.width > 0 && header.height > 0 && maxval == 255 && formatFor(header.depth) != QImage::Format_Invalid
+            && qint64(header.width) * header.depth <= std::numeric_limits<int>::max()
+            && header.offset + qint64(header.width) * header.height * header.depth <= length;
+    return header;
+}
+
+/*!
+ * \brief Close the mapping of a file once the QImage wrapping it is gone.
+ * \param file The QFile holding the mapping
+ */
+void rawimage::release(void *file) {
+    delete static_cast<QFile*>(file); // unmaps and closes it
+}
+
+/*!
+ * \brief Wrap the pixels of a binary PGM, PPM or PAM file held in memory in a QImage.
+ *
+ * Gray images are Grayscale8, RGB images RGB888 and RGB images with alpha RGBA8888, the layouts the samples are \
+ * stored in, so the image uses the pixels in place when they are aligned. Otherwise, and for planar files, \
+ * the pixels are copied and the cleanup function is called at once. If the copy cannot be allocated, \
+ * e.g. because it is over the 2 GB QImage allows, the image is null.
+ *
+ * \param data The file
+ * \param length Its size
+ * \param cleanup Called with info once the image no longer uses data, may be nullptr
+ * \param info Passed to cleanup
+ * \return The image, or a null image if the file is not one with 8-bit samples
+ */
+QImage rawimage::wrap(const uchar *data, qint64 length, QImageCleanupFunction cleanup, void *info) {
+    Header header = data != nullptr ? parse(data, length) : Header();
+    int w = header.width;
+    int h = header.height;
+    QImage::Format format = formatFor(header.depth);
+    const uchar *pixels = data + header.offset;
+    QImage image;
+    if (!header.valid) {
+        // nothing to read
+    } else if (header.planar) {
+        // Interleave the channels, one plane after another
+        image = QImage(w, h, format);
+        qint64 plane = qint64(w) * h;
+        for (int i = 0; i < h && !image.isNull(); i++) { // null over 2 GB or when out of memory
+            uchar *line = image.scanLine(i);
+            for (int c = 0; c < header.depth; c++) {
+                const uchar *in = pixels + c * plane + qint64(i) * w;
+                for (int j = 0; j < w; j++) {
+                    line[j * header.depth + c] = in[j];
+                }
+            }
+        }
+    } else if (reinterpret_cast<quintptr>(pixels) % 4 != 0) {
+        // QImage needs aligned pixels, so files from elsewhere may have to be copied
+        image = QImage(pixels, w, h, w * header.depth, format).copy();
+    } else {
+        return QImage(pixels, w, h, w * header.depth, format, cleanup, info);
+    }
+    if (cleanup != nullptr) {
+        cleanup(info);
+    }
+    return image;
+}
+
+/*!
+ * \brief Read a binary PGM, PPM or PAM file by mapping it. The image uses the mapped pixels, see wrap().
+ * \param path The file
+ * \return The image, or a null image if the file is not one with 8-bit samples
+ */
+QImage rawimage::read(const QString &path) {
+    QFile *file = new QFile(path);
+    uchar *data = file->open(QIODevice::ReadOnly) ? file->map(0, file->size()) : nullptr;
+    return wrap(data, file->size(), &rawimage::release, file);
+}
+
+/*!
+ * \brief Wrap the pixels of a binary PGM, PPM or PAM file held in memory, e.g. in shared memory, in a QImage.
+ * \param data The file, which must outlive the image
+ * \param length Its size
+ * \return The image, or a null image if the file is not one with 8-bit samples
+ */
+QImage rawimage::fromData(const uchar *data, qint64 length) {
+    return wrap(data, length, nullptr, nullptr);
+}
+
+/*!
+ * \brief Read the size of a binary PGM, PPM or PAM file from its header.
+ * \param path The file
+ * \return The size, or an invalid size if read() cannot read the file
+ */
+QSize rawimage::size(const QString &path) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QSize();
+    }
+    uchar *data = file.map(0, file.size());
+    if (data == nullptr) {
+        return QSize();
+    }
+    Header header = parse(data, file.size());
+    return header.valid ? QSize(header.width, header.height) : QSize();
+}
+
+/*!
+ * \brief Make the header of a file, padded with a comment so that it ends on an ALIGNMENT boundary.
+ * \param width The width
+ * \param height The height
+ * \param depth The samples per pixel
+ * \param planar Whether the samples are stored channel by channel
+ * \param suffix The extension of the file, which chooses PGM, PPM or PAM
+ * \return The header
+ */
+QByteArray rawimage::header(int width, int height, int depth, bool planar, const QString &suffix) {
+    QByteArray start;
+    QByteArray end;
+    if (suffix == "pgm" || suffix == "ppm") {
+        start = suffix == "pgm" ? "P5\n" : "P6\n";
+        end = QByteArray::number(width) + " " + QByteArray::number(height) + "\n255\n";
+    } else {
+        QByteArray tupleType = depth == 1 ? "GRAYSCALE" : depth == 3 ? "RGB" : "RGB_ALPHA";
+        start = "P7\nWIDTH " + QByteArray::number(width) + "\nHEIGHT " + QByteArray::number(height)
+                + "\nDEPTH " + QByteArray::number(depth) + "\nMAXVAL 255\nTUPLTYPE " + tupleType
+                + (planar ? "_PLANAR\n" : "\n");
+        end = "ENDHDR\n";
+    }
+    int padding = (ALIGNMENT - (start.size() + end.size() + 2) % ALIGNMENT) % ALIGNMENT;
+    return start + "#" + QByteArray(padding, ' ') + "\n" + end;
+}
+
+/*!
+ * \brief Copy the pixels of an image after its header, interleaved or channel by channel.
+ * \param image The image, in the format formatFor() gives for the depth
+ * \param depth The samples per pixel
+ * \param planar Whether the samples are stored channel by channel
+ * \param pixels Where the pixels go
+ */
+void rawimage::fill(const QImage &image, int depth, bool planar, uchar *pixels) {
+    int w = image.width();
+    int h = image.height();
+    qint64 plane = qint64(w) * h;
+    for (int i = 0; i < h; i++) {
+        const uchar *line = image.constScanLine(i);
+        if (!planar) {
+            memcpy(pixels + qint64(i) * w * depth, line, static_cast<size_t>(w) * depth);
+            continue;
+        }
+        for (int c = 0; c < depth; c++) {
+            uchar *out = pixels + c * plane + qint64(i) * w;
+            for (int j = 0; j < w; j++) {
+                out[j] = line[j * depth + c];
+            }
+        }
+    }
+}
+
+/*!
+ * \brief Write an image by mapping the new file, as PGM, PPM, PAM or planar PAM depending on its extension.
+ *
+ * PGM keeps the gray levels and PPM the colors; PAM and planar PAM keep the alpha channel too, if there is one.
+ *
+ * \param img The image
+ * \param path The file, ending in .pgm, .ppm, .pam or .planar
+ * \return Whether it was written
+ */
+bool rawimage::write(const QImage &img, const QString &path) {
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (img.isNull() || !canWrite(path)) {
+        return false;
+    }
+    int depth = suffix == "pgm" ? 1 : suffix == "ppm" ? 3 : img.hasAlphaChannel() ? 4 : 3;
+    bool planar = suffix == "planar";
+    QImage image = img.convertToFormat(formatFor(depth)); // no copy if it already is, e.g. when it was read by read()
+    QByteArray head = header(image.width(), image.height(), depth, planar, suffix);
+    qint64 total = head.size() + qint64(image.width()) * image.height() * depth;
+
+    // Written next to the file and renamed over it, so images still mapping the old file keep their pixels
+    QFile file(path + ".part");
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Truncate) || !file.resize(total)) {
+        file.remove();
+        return false;
+    }
+    uchar *data = file.map(0, total);
+    if (data == nullptr) {
+        file.remove();
+        return false;
+    }
+    memcpy(data, head.constData(), head.size());
+    fill(image, depth, planar, data + head.size());
+    file.unmap(data);
+    file.close();
+    QFile::remove(path);
+    if (!file.rename(path)) {
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+/*!
+ * \brief The size of an image written as PAM by toData().
+ * \param image The image
+ * \return The bytes needed, 0 for a null image
+ */
+qint64 rawimage::dataSize(const QImage &image) {
+    if (image.isNull()) {
+        return 0;
+    }
+    int depth = image.hasAlphaChannel() ? 4 : 3;
+    return header(image.width(), image.height(), depth, false, "pam").size() + qint64(image.width()) * image.height() * depth;
+}
+
+/*!
+ * \brief Write an image as PAM into memory, e.g. shared memory, keeping its alpha channel if it has one.
+ * \param img The image
+ * \param data Where to write it
+ * \param length The bytes available there, at least dataSize()
+ * \return Whether it fitted
+ */
+bool rawimage::toData(const QImage &img, uchar *data, qint64 length) {
+    if (img.isNull() || length < dataSize(img)) {
+        return false;
+    }
+    int depth = img.hasAlphaChannel() ? 4 : 3;
+    QImage image = img.convertToFormat(formatFor(depth));
+    QByteArray head = header(image.width(), image.height(), depth, false, "pam");
+    memcpy(data, head.constData(), head.size());
+    fill(image, depth, false, data + head.size());
+    return true;
+}
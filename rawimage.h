@@ -0,0 +1,58 @@
+#ifndef RAWIMAGE_H
+#define RAWIMAGE_H
+
+#include <QImage>
+#include <QSize>
+#include <QString>
+
+/*!
+ * \brief A class reading and writing uncompressed images by memory-mapping them: binary PGM, PPM and PAM, \
+ * and a planar variant of PAM.
+ *
+ * Reading maps the file and wraps the mapped pixels in a QImage without copying or converting them, so an \
+ * image is only read from the page cache when its pixels are used, and the mapping lives as long as the \
+ * image. Filters that write into the image get their own copy then, as with any read-only QImage. \
+ * Writing maps the new file and copies the rows straight into it. The header is padded with a comment so \
+ * the pixels start on an ALIGNMENT boundary, which a QImage needs to wrap them; files from elsewhere whose \
+ * pixels are not aligned, or that use more than 8 bits per sample, are copied or left to Qt instead.
+ *
+ * The planar variant is a PAM file whose TUPLTYPE ends in "_PLANAR" and whose samples are stored one whole \
+ * channel after another, e.g. all the red samples, then all the green ones, then all the blue ones. \
+ * It is written to files ending in .planar and is interleaved into a QImage when read.
+ *
+ * The same layout can be read from and written to memory, which is how the batch server passes images \
+ * through shared memory.
+ */
+class rawimage {
+public:
+    rawimage() = delete;
+    static bool canRead(const QByteArray&);
+    static bool canWrite(const QString&);
+    static QImage read(const QString&);
+    static QImage fromData(const uchar*, qint64);
+    static QSize size(const QString&);
+    static bool write(const QImage&, const QString&);
+    static qint64 dataSize(const QImage&);
+    static bool toData(const QImage&, uchar*, qint64);
+private:
+    /*!
+     * \brief What the header of a file says.
+     */
+    struct Header {
+        bool valid = false; /*!< Whether it could be read and describes 8-bit samples */
+        int width = 0; /*!< The width in pixels */
+        int height = 0; /*!< The height in pixels */
+        int depth = 0; /*!< The samples per pixel: 1 for gray, 3 for RGB, 4 for RGB with alpha */
+        bool planar = false; /*!< Whether the samples are stored channel by channel */
+        qint64 offset = 0; /*!< Where the pixels start */
+    };
+    static Header parse(const uchar*, qint64);
+    static QImage wrap(const uchar*, qint64, QImageCleanupFunction, void*);
+    static QByteArray header(int, int, int, bool, const QString&);
+    static void fill(const QImage&, int, bool, uchar*);
+    static void release(void*);
+    static const int ALIGNMENT; /*!< The boundary the pixels of written files start on, in bytes */
+    static const int MAX_HEADER; /*!< The most bytes read looking for the end of a header */
+};
+
+#endif // RAWIMAGE_H
@@ -0,0 +1,247 @@
+#include "roundtrip.h"
+#include "basefilter.h"
+#include "blurfilter.h"
+#include "deblurfilter.h"
+#include "decodefilter.h"
+#include "encodefilter.h"
+#include "extractfilter.h"
+#include "gif.h"
+#include "insertfilter.h"
+#include "synthetic.h"
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QMovie>
+#include <QTemporaryDir>
+#include <cstdio>
+
+const qint64 RoundTrip::MEMORY_BUDGET = 64 * 1024;
+
+/*!
+ * \brief Why a round trip failed.
+ * \return The first threshold or budget it missed, or an empty string if it passed
+ */
+QString RoundTrip::Result::failure() const {
+    if (!error.isEmpty()) {
+        return error;
+    }
+    if (comparison.psnr < minPsnr) {
+        return QString("PSNR %1 dB is below %2 dB").arg(comparison.psnr, 0, 'f', 2).arg(minPsnr);
+    }
+    if (comparison.exact < minExact) {
+        return QString("%1% exact pixels is below %2%").arg(comparison.exact * 100, 0, 'f', 2).arg(minExact * 100);
+    }
+    if (milliseconds > timeBudget) {
+        return QString("%1 ms is over the budget of %2 ms").arg(milliseconds).arg(timeBudget);
+    }
+    if (memory > memoryBudget) {
+        return QString("%1 KB of memory is over the budget of %2 KB").arg(memory).arg(memoryBudget);
+    }
+    return QString();
+}
+
+/*!
+ * \brief constructor: set how much the time budgets are stretched.
+ * \param scale The factor applied to every time budget
+ */
+RoundTrip::RoundTrip(double scale) :
+        timeScale(scale) {
+}
+
+/*!
+ * \brief Read a field of /proc/self/status, where Linux reports the memory of the process.
+ * \param field e.g. "VmRSS" or "VmHWM"
+ * \return The value in kilobytes, -1 on other systems
+ */
+qint64 RoundTrip::memoryStatus(const QByteArray &field) {
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+            if (line.startsWith(field + ":")) {
+                return line.mid(field.size() + 1).trimmed().split(' ').first().toLongLong();
+            }
+        }
+    }
+#else
+    Q_UNUSED(field);
+#endif
+    return -1;
+}
+
+/*!
+ * \brief Make the peak memory of the process start again from the memory it uses now (Linux 4.0 and later).
+ */
+void RoundTrip::resetPeakMemory() {
+#ifdef Q_OS_LINUX
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly)) {
+        clearRefs.write("5");
+    }
+#endif
+}
+
+/*!
+ * \brief Run one round trip, timing it and measuring how much memory it needs.
+ * \param name The round trip and the image
+ * \param minPsnr The lowest PSNR allowed
+ * \param minExact The lowest share of exact pixels allowed
+ * \param timeBudget The most time allowed in milliseconds, before timeScale
+ * \param body Runs the round trip, setting the image it should give back and the error if a filter failed, and returns what it gave back
+ */
+void RoundTrip::check(const QString &name, double minPsnr, double minExact, qint64 timeBudget,
+        const std::function<QImage(QImage&, QString&)> &body) {
+    Result result;
+    result.name = name;
+    result.minPsnr = minPsnr;
+    result.minExact = minExact;
+    result.timeBudget = static_cast<qint64>(timeBudget * timeScale);
+    result.memoryBudget = MEMORY_BUDGET;
+
+    resetPeakMemory();
+    qint64 before = memoryStatus("VmRSS");
+    QElapsedTimer timer;
+    timer.start();
+    QImage expected;
+    QImage actual = body(expected, result.error);
+    result.milliseconds = timer.elapsed();
+    qint64 peak = memoryStatus("VmHWM");
+    if (before >= 0 && peak >= 0) {
+        result.memory = qMax<qint64>(0, peak - before);
+    }
+    result.comparison = imagemetrics::compare(actual, expected);
+    results.append(result);
+
+    QString failure = result.failure();
+    fprintf(stderr, "%-40s %s\n", qPrintable(name), failure.isEmpty() ? "ok" : qPrintable(failure));
+}
+
+/*!
+ * \brief Run every round trip on every image of the corpus, with the result cache off.
+ *
+ * The corpus has 80x80 images, which every strength divides, and 64x64 images, which leave narrower blocks \
+ * at the right and bottom edges. The thresholds are a little below the accuracy the round trips had when \
+ * they were set: deblurring is not exact, because the residues only keep six decimal digits, decoding gives \
+ * back the four most significant bits, and a GIF frame with more than 256 colors loses some in its palette.
+ *
+ * \return The outcome of every round trip
+ */
+QVector<RoundTrip::Result> RoundTrip::run() {
+    results.clear();
+    BaseFilter::resultCache().setEnabled(false);
+    QTemporaryDir dir;
+
+    for (int side : QVector<int>{64, 80}) {
+        for (synthetic::Entropy entropy : synthetic::entropies()) {
+            QImage original = synthetic::image(side, side, entropy);
+            QString suffix = QString(" %1x%1 %2").arg(side).arg(synthetic::name(entropy));
+
+            // Blur then deblur, with the strength known
+            for (int s : QVector<int>{10, 16, 20}) {
+                check("blur/deblur" + suffix + " s" + QString::number(s), s == 16 ? 36 : 48, s == 16 ? 0.05 : 0.5, 3000,
+                        [&](QImage &expected, QString &error) {
+                    expected = original;
+                    BlurFilter blur;
+                    blur.setImage(original);
+                    blur.setSize(s);
+                    blur.apply();
+                    DeblurFilter deblur;
+                    deblur.setImage(blur.getImage(), blur.getRedResidue(), blur.getGreenResidue(), blur.getBlueResidue());
+                    deblur.setSize(s);
+                    deblur.apply();
+                    error = deblur.getError();
+                    return deblur.getImage();
+                });
+            }
+
+            // Encode then decode: the secret comes back with its four most significant bits
+            QImage secret = synthetic::image(side, side, entropy, 2);
+            check("encode/decode" + suffix, 0, 1, 500, [&](QImage &expected, QString&) {
+                expected = imagemetrics::quantize(secret, 4);
+                EncodeFilter encoder;
+                encoder.setImage(original);
+                encoder.setSecret(secret);
+                encoder.apply();
+                DecodeFilter decoder;
+                decoder.setImage(encoder.getImage());
+                decoder.apply();
+                return decoder.getImage();
+            });
+
+            // Insert into a five-frame GIF then extract: exact when the secret has at most 256 colors
+            QString base = dir.filePath("base.gif");
+            QString inserted = dir.filePath("inserted.gif");
+            GifWriter writer;
+            GifBegin(&writer, QFile::encodeName(base).constData(), side, side, 10);
+            for (int k = 0; k < 5; k++) {
+                QImage frame = synthetic::image(side, side, synthetic::Medium, 10 + k).convertToFormat(QImage::Format_RGBA8888);
+                GifWriteFrame(&writer, frame.constBits(), side, side, 10);
+            }
+            GifEnd(&writer);
+            double minPsnr = entropy == synthetic::Low ? 0 : entropy == synthetic::Medium ? 28 : 22;
+            check("insert/extract" + suffix, minPsnr, entropy == synthetic::Low ? 1 : 0, 2000, [&](QImage &expected, QString&) {
+                expected = original;
+                QMovie baseMovie(base);
+                InsertFilter insert;
+                insert.setMovie(&baseMovie);
+                insert.setImage(original);
+                insert.setDestination(inserted);
+                insert.apply();
+                QMovie insertedMovie(inserted);
+                ExtractFilter extract;
+                extract.setMovie(&insertedMovie);
+                extract.apply();
+                return extract.getImage();
+            });
+        }
+    }
+    BaseFilter::resultCache().setEnabled(true);
+    return results;
+}
+
+/*!
+ * \brief Put the outcomes in a JSON document, to keep next to the benchmark results.
+ * \param results The outcomes
+ * \return The document
+ */
+QJsonDocument RoundTrip::toJson(const QVector<Result> &results) {
+    QJsonArray cases;
+    for (const Result &result : results) {
+        QJsonObject item;
+        item["name"] = result.name;
+        item["psnr"] = qIsInf(result.comparison.psnr) ? QJsonValue("inf") : QJsonValue(result.comparison.psnr);
+        item["exact"] = result.comparison.exact;
+        item["max_error"] = result.comparison.maxError;
+        item["milliseconds"] = result.milliseconds;
+        item["memory_kb"] = result.memory;
+        item["passed"] = result.failure().isEmpty();
+        item["failure"] = result.failure();
+        cases.append(item);
+    }
+    QJsonObject root;
+    root["results"] = cases;
+    return QJsonDocument(root);
+}
+
+/*!
+ * \brief Put the outcomes in a table for people to read.
+ * \param results The outcomes
+ * \return One line per round trip
+ */
+QString RoundTrip::toTable(const QVector<Result> &results) {
+    QString table = QString("round trip").leftJustified(40) + QString("PSNR").rightJustified(9)
+            + QString("exact").rightJustified(9) + QString("max").rightJustified(5) + QString("ms").rightJustified(8)
+            + QString("KB").rightJustified(9) + "  result\n";
+    for (const Result &result : results) {
+        QString failure = result.failure();
+        table += result.name.leftJustified(40)
+                + (qIsInf(result.comparison.psnr) ? QString("inf") : QString::number(result.comparison.psnr, 'f', 2)).rightJustified(9)
+                + QString::number(result.comparison.exact * 100, 'f', 2).rightJustified(8) + "%"
+                + QString::number(result.comparison.maxError).rightJustified(5)
+                + QString::number(result.milliseconds).rightJustified(8)
+                + QString::number(result.memory).rightJustified(9)
+                + "  " + (failure.isEmpty() ? QString("ok") : "FAILED: " + failure) + "\n";
+    }
+    return table;
+}
@@ -0,0 +1,48 @@
+#ifndef ROUNDTRIP_H
+#define ROUNDTRIP_H
+
+#include <QImage>
+#include <QJsonDocument>
+#include <QString>
+#include <QVector>
+#include <functional>
+#include "imagemetrics.h"
+
+/*!
+ * \brief Checks that blur then deblur, encode then decode, and insert then extract still give back the image.
+ *
+ * Every round trip runs on a fixed corpus of synthetic images, and must stay within the accuracy it had \
+ * when the thresholds were set as well as within a time and memory budget, so that any change to these \
+ * paths shows at once whether it broke them or made them slower.
+ */
+class RoundTrip {
+public:
+    /*!
+     * \brief The outcome of one round trip on one image.
+     */
+    struct Result {
+        QString name; /*!< The round trip and the image */
+        imagemetrics::Comparison comparison; /*!< How far the image given back is from what it should be */
+        qint64 milliseconds = 0; /*!< How long the round trip took */
+        qint64 memory = -1; /*!< How much the peak memory grew during the round trip in kilobytes, -1 if unknown */
+        double minPsnr = 0; /*!< The lowest PSNR allowed */
+        double minExact = 0; /*!< The lowest share of exact pixels allowed */
+        qint64 timeBudget = 0; /*!< The most time allowed in milliseconds */
+        qint64 memoryBudget = 0; /*!< The most memory growth allowed in kilobytes */
+        QString error; /*!< Why a filter failed, or an empty string */
+        QString failure() const;
+    };
+    explicit RoundTrip(double timeScale = 1);
+    QVector<Result> run();
+    static QJsonDocument toJson(const QVector<Result>&);
+    static QString toTable(const QVector<Result>&);
+private:
+    void check(const QString&, double, double, qint64, const std::function<QImage(QImage&, QString&)>&);
+    static qint64 memoryStatus(const QByteArray&);
+    static void resetPeakMemory();
+    static const qint64 MEMORY_BUDGET; /*!< The most memory growth allowed for any round trip, in kilobytes */
+    double timeScale; /*!< The factor applied to every time budget, e.g. for debug builds or slow machines */
+    QVector<Result> results; /*!< The round trips run so far */
+};
+
+#endif // ROUNDTRIP_H
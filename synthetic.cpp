@@ -0,0 +1,66 @@
+#include "synthetic.h"
+
+/*!
+ * \brief All the entropy levels, from the least detail to the most.
+ * \return The entropy levels
+ */
+QVector<synthetic::Entropy> synthetic::entropies() {
+    return QVector<Entropy>{Low, Medium, High};
+}
+
+/*!
+ * \brief The name of an entropy level, as used in reports.
+ * \param entropy The entropy level
+ * \return "low", "medium" or "high"
+ */
+QString synthetic::name(Entropy entropy) {
+    return entropy == Low ? "low" : entropy == Medium ? "medium" : "high";
+}
+
+/*!
+ * \brief Step a SplitMix64 generator, which gives the same numbers on every platform unlike qrand().
+ * \param state The state of the generator, updated
+ * \return The next random number
+ */
+quint64 synthetic::next(quint64 &state) {
+    quint64 z = (state += Q_UINT64_C(0x9E3779B97F4A7C15));
+    z = (z ^ (z >> 30)) * Q_UINT64_C(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * Q_UINT64_C(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+/*!
+ * \brief Generate an opaque image.
+ * \param width The width of the image
+ * \param height The height of the image
+ * \param entropy How much detail the image has
+ * \param seed Images with the same size, entropy and seed are identical
+ * \return The image, in the format PNG files are loaded in
+ */
+QImage synthetic::image(int width, int height, Entropy entropy, quint64 seed) {
+    QImage img(width, height, QImage::Format_RGB32);
+    quint64 state = seed;
+
+    // 4 by 4 rectangles of random colors
+    QRgb cells[16];
+    for (int k = 0; k < 16; k++) {
+        cells[k] = static_cast<QRgb>(next(state)) | 0xFF000000;
+    }
+
+    for (int i = 0; i < height; i++) {
+        QRgb *line = reinterpret_cast<QRgb*>(img.scanLine(i));
+        for (int j = 0; j < width; j++) {
+            if (entropy == Low) {
+                line[j] = cells[i * 4 / height * 4 + j * 4 / width];
+            } else if (entropy == Medium) {
+                int noise = static_cast<int>(next(state) % 17) - 8;
+                line[j] = qRgb(qBound(0, j * 255 / qMax(1, width - 1) + noise, 255),
+                        qBound(0, i * 255 / qMax(1, height - 1) + noise, 255),
+                        qBound(0, (i + j) * 255 / qMax(1, width + height - 2) - noise, 255));
+            } else {
+                line[j] = static_cast<QRgb>(next(state)) | 0xFF000000;
+            }
+        }
+    }
+    return img;
+}
@@ -0,0 +1,31 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <QImage>
+#include <QString>
+#include <QVector>
+#include <QtGlobal>
+
+/*!
+ * \brief A class generating synthetic images that are the same on every machine, used to measure the filters.
+ */
+class synthetic {
+public:
+    synthetic() = delete;
+
+    /*!
+     * \brief How much detail a synthetic image has, which decides how well GIF palettes and PNG compression do on it.
+     */
+    enum Entropy {
+        Low, /*!< A few flat rectangles */
+        Medium, /*!< Smooth gradients with a little noise */
+        High /*!< Independent random pixels */
+    };
+    static QVector<Entropy> entropies();
+    static QString name(Entropy);
+    static QImage image(int width, int height, Entropy entropy, quint64 seed = 1);
+private:
+    static quint64 next(quint64 &state);
+};
+
+#endif // SYNTHETIC_H
@@ -0,0 +1,124 @@
+#include "tiledimageitem.h"
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <QtMath>
+
+const int TiledImageItem::TILE_SIZE = 256;
+
+const int TiledImageItem::CACHE_SIZE = 32 * 1024;
+
+/*!
+ * \brief constructor: create an empty item.
+ * \param parent The parent item
+ */
+TiledImageItem::TiledImageItem(QGraphicsItem *parent) :
+        QGraphicsItem(parent), tiles(CACHE_SIZE) {
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption); // needed for the exposed rectangle in paint()
+}
+
+/*!
+ * \brief A mutator for the image being drawn.
+ *
+ * The item is as large as the full-resolution image; scale it to change its size in the scene.
+ * The pyramid is not copied, so that it can be updated in place; call this again after rebuilding it.
+ *
+ * \param pyr The pyramid of the image, which must outlive the item
+ */
+void TiledImageItem::setPyramid(const ImagePyramid *pyr) {
+    prepareGeometryChange();
+    pyramid = pyr;
+    tiles.clear();
+    update();
+}
+
+/*!
+ * \brief Drop the cached tiles showing part of the image that has changed, and repaint that part.
+ * \param rect The changed area, in full-resolution pixels
+ */
+void TiledImageItem::invalidate(const QRect &rect) {
+    if (pyramid == nullptr || pyramid->isNull()) {
+        return;
+    }
+    QSize fullSize = pyramid->level(0).size();
+    const QList<quint64> keys = tiles.keys();
+    for (quint64 key : keys) {
+        int index = static_cast<int>(key >> 48);
+        int row = static_cast<int>((key >> 24) & 0xFFFFFF);
+        int column = static_cast<int>(key & 0xFFFFFF);
+        QSize levelSize = pyramid->level(index).size();
+        qreal sx = levelSize.width() / static_cast<qreal>(fullSize.width());
+        qreal sy = levelSize.height() / static_cast<qreal>(fullSize.height());
+        QRectF area(column * TILE_SIZE / sx, row * TILE_SIZE / sy, TILE_SIZE / sx, TILE_SIZE / sy);
+        if (area.intersects(QRectF(rect))) {
+            tiles.remove(key);
+        }
+    }
+    update(QRectF(rect));
+}
+
+/*!
+ * \brief The area of the item in its own coordinates, i.e. the full-resolution image.
+ * \return The bounding rectangle
+ */
+QRectF TiledImageItem::boundingRect() const {
+    if (pyramid == nullptr || pyramid->isNull()) {
+        return QRectF();
+    }
+    return QRectF(QPointF(0, 0), pyramid->level(0).size());
+}
+
+/*!
+ * \brief Draw the visible tiles of the pyramid level closest to the current zoom.
+ * \param painter The painter
+ * \param option Provides the exposed rectangle and the level of detail
+ * \param widget Unused
+ */
+void TiledImageItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
+    Q_UNUSED(widget);
+    if (pyramid == nullptr || pyramid->isNull()) {
+        return;
+    }
+
+    // Pick the level from how large one image pixel currently is on screen
+    qreal lod = QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform());
+    int index = pyramid->levelFor(lod);
+    QSize fullSize = pyramid->level(0).size();
+    QSize levelSize = pyramid->level(index).size();
+    qreal sx = levelSize.width() / static_cast<qreal>(fullSize.width());
+    qreal sy = levelSize.height() / static_cast<qreal>(fullSize.height());
+
+    // Find the tiles of that level covering the exposed part of the item
+    QRectF exposed = option->exposedRect.intersected(boundingRect());
+    int firstColumn = qMax(0, qFloor(exposed.left() * sx / TILE_SIZE));
+    int lastColumn = qMin((levelSize.width() - 1) / TILE_SIZE, qFloor(exposed.right() * sx / TILE_SIZE));
+    int firstRow = qMax(0, qFloor(exposed.top() * sy / TILE_SIZE));
+    int lastRow = qMin((levelSize.height() - 1) / TILE_SIZE, qFloor(exposed.bottom() * sy / TILE_SIZE));
+
+    for (int row = firstRow; row <= lastRow; row++) {
+        for (int column = firstColumn; column <= lastColumn; column++) {
+            QPixmap *pixmap = tile(index, column, row);
+            QRectF target(column * TILE_SIZE / sx, row * TILE_SIZE / sy,
+                    pixmap->width() / sx, pixmap->height() / sy);
+            painter->drawPixmap(target, *pixmap, QRectF(pixmap->rect()));
+        }
+    }
+}
+
+/*!
+ * \brief Get one tile, making it from the pyramid if it is not in the cache.
+ * \param index The level of the pyramid
+ * \param column The column of the tile
+ * \param row The row of the tile
+ * \return The tile, owned by the cache and valid until the next call
+ */
+QPixmap *TiledImageItem::tile(int index, int column, int row) {
+    quint64 key = (static_cast<quint64>(index) << 48) | (static_cast<quint64>(row) << 24) | static_cast<quint64>(column);
+    QPixmap *pixmap = tiles.object(key);
+    if (pixmap == nullptr) {
+        QImage level = pyramid->level(index);
+        QRect area = QRect(column * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE).intersected(level.rect());
+        pixmap = new QPixmap(QPixmap::fromImage(level.copy(area)));
+        tiles.insert(key, pixmap, qMax(1, area.width() * area.height() * 4 / 1024)); // cost in kilobytes
+    }
+    return pixmap;
+}
@@ -0,0 +1,30 @@
+#ifndef TILEDIMAGEITEM_H
+#define TILEDIMAGEITEM_H
+
+#include <QGraphicsItem>
+#include <QCache>
+#include <QPixmap>
+#include "imagepyramid.h"
+
+/*!
+ * \brief A graphics item that draws an image tile by tile, from the pyramid level matching the current zoom.
+ *
+ * Only the tiles that are visible get turned into pixmaps, and only a bounded number of them are kept,
+ * so images far larger than a single QPixmap can hold can be zoomed and panned with constant memory.
+ */
+class TiledImageItem: public QGraphicsItem {
+public:
+    TiledImageItem(QGraphicsItem *parent = nullptr);
+    void setPyramid(const ImagePyramid*);
+    void invalidate(const QRect&);
+    virtual QRectF boundingRect() const override;
+    virtual void paint(QPainter*, const QStyleOptionGraphicsItem*, QWidget*) override;
+private:
+    static const int TILE_SIZE; /*!< The width and height of a tile in pixels */
+    static const int CACHE_SIZE; /*!< The most tile memory kept, in kilobytes */
+    QPixmap *tile(int, int, int);
+    const ImagePyramid *pyramid = nullptr; /*!< The image being drawn and its downscaled copies, owned by the scene */
+    QCache<quint64, QPixmap> tiles; /*!< The most recently drawn tiles, keyed by level and position */
+};
+
+#endif // TILEDIMAGEITEM_H